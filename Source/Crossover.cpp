@@ -0,0 +1,294 @@
+#include "Crossover.h"
+
+namespace
+{
+    // Butterworth pole pairs of the filters that are squared to make each Linkwitz-Riley slope.
+    // LR2 squares a first order Butterworth, written here as a double pole with Q = 0.5.
+    const std::array<double, 1> lr2Qs{ 0.5 };
+    const std::array<double, 1> lr4Qs{ 0.70710678118654752 };
+    const std::array<double, 2> lr8Qs{ 0.54119610014619698, 1.30656296487637653 };
+
+    double prewarp(double cutoff, double sampleRate)
+    {
+        return std::tan(juce::MathConstants<double>::pi * cutoff / sampleRate);
+    }
+}
+
+//==============================================================================
+LinkwitzRileyCrossover::Coefficients LinkwitzRileyCrossover::makeLowPass(double K, double Q)
+{
+    auto norm = 1.0 / (1.0 + K / Q + K * K);
+
+    Coefficients c;
+    c.b0 = K * K * norm;
+    c.b1 = 2.0 * c.b0;
+    c.b2 = c.b0;
+    c.a1 = 2.0 * (K * K - 1.0) * norm;
+    c.a2 = (1.0 - K / Q + K * K) * norm;
+    return c;
+}
+
+LinkwitzRileyCrossover::Coefficients LinkwitzRileyCrossover::makeHighPass(double K, double Q, bool invert)
+{
+    auto norm = 1.0 / (1.0 + K / Q + K * K);
+    auto gain = invert ? -norm : norm;
+
+    Coefficients c;
+    c.b0 = gain;
+    c.b1 = -2.0 * gain;
+    c.b2 = gain;
+    c.a1 = 2.0 * (K * K - 1.0) * norm;
+    c.a2 = (1.0 - K / Q + K * K) * norm;
+    return c;
+}
+
+LinkwitzRileyCrossover::Coefficients LinkwitzRileyCrossover::makeAllPass(double K, double Q)
+{
+    auto c = makeLowPass(K, Q);
+    c.b0 = c.a2;
+    c.b1 = c.a1;
+    c.b2 = 1.0;
+    return c;
+}
+
+LinkwitzRileyCrossover::Coefficients LinkwitzRileyCrossover::makeFirstOrderAllPass(double K)
+{
+    Coefficients c;
+    c.b0 = (K - 1.0) / (K + 1.0);
+    c.b1 = 1.0;
+    c.a1 = c.b0;
+    return c;
+}
+
+void LinkwitzRileyCrossover::Section::setLane(size_t lane, const Coefficients& c)
+{
+    b0.set(lane, (float) c.b0);
+    b1.set(lane, (float) c.b1);
+    b2.set(lane, (float) c.b2);
+    a1.set(lane, (float) c.a1);
+    a2.set(lane, (float) c.a2);
+}
+
+LinkwitzRileyCrossover::LinkwitzRileyCrossover()
+{
+    leftLanes = rightLanes = Vec::expand(0.f);
+    for (size_t lane = 0; lane < 2; ++lane)
+    {
+        leftLanes.set(lane, 1.f);
+        rightLanes.set(lane + 2, 1.f);
+    }
+
+    updateCoefficients();
+}
+
+void LinkwitzRileyCrossover::bindState(DspStateArena& arena)
+{
+    z1 = arena.take<Vec>((size_t) (3 * maxSections));
+    z2 = arena.take<Vec>((size_t) (3 * maxSections));
+}
+
+void LinkwitzRileyCrossover::prepare(const juce::dsp::ProcessSpec& spec)
+{
+    jassert(spec.numChannels <= (juce::uint32) maxChannels);
+
+    sampleRate = spec.sampleRate;
+    numChannels = juce::jmin((int) spec.numChannels, maxChannels);
+
+    updateCoefficients();
+    reset();
+}
+
+void LinkwitzRileyCrossover::reset()
+{
+    if (z1 == nullptr)
+        return;
+
+    std::fill(z1, z1 + 3 * maxSections, Vec::expand(0.f));
+    std::fill(z2, z2 + 3 * maxSections, Vec::expand(0.f));
+}
+
+void LinkwitzRileyCrossover::setSlope(Slope newSlope)
+{
+    if (newSlope == slope)
+        return;
+
+    // The number of active sections changes, so whatever is left in the state is meaningless.
+    slope = newSlope;
+    updateCoefficients();
+    reset();
+}
+
+void LinkwitzRileyCrossover::setCrossoverFrequencies(float lowMidFreq, float midHighFreq)
+{
+    if (lowMidFreq == lowMidCutoff && midHighFreq == midHighCutoff)
+        return;
+
+    lowMidCutoff = lowMidFreq;
+    midHighCutoff = midHighFreq;
+    updateCoefficients();
+}
+
+void LinkwitzRileyCrossover::setMidSide(int band, bool shouldEncodeMidSide)
+{
+    jassert(juce::isPositiveAndBelow(band, numBands));
+
+    midSide[(size_t) band] = shouldEncodeMidSide;
+}
+
+void LinkwitzRileyCrossover::updateCoefficients()
+{
+    auto nyquistLimit = [sr = sampleRate](float f) { return juce::jlimit(1.0, sr * 0.49, (double) f); };
+    auto K1 = prewarp(nyquistLimit(lowMidCutoff), sampleRate);
+    auto K2 = prewarp(nyquistLimit(midHighCutoff), sampleRate);
+
+    // For every slope the low pass and high pass of a pair add up to the allpass built from the
+    // same pole pairs, except LR2 where the high pass has to be inverted for that to hold.
+    auto invertHighPass = slope == Slope::db12;
+
+    std::array<double, 2> qs{};
+    size_t numQs = 0;
+    switch (slope)
+    {
+        case Slope::db12: numQs = lr2Qs.size(); std::copy(lr2Qs.begin(), lr2Qs.end(), qs.begin()); break;
+        case Slope::db24: numQs = lr4Qs.size(); std::copy(lr4Qs.begin(), lr4Qs.end(), qs.begin()); break;
+        case Slope::db48: numQs = lr8Qs.size(); std::copy(lr8Qs.begin(), lr8Qs.end(), qs.begin()); break;
+    }
+
+    // Each pole pair is applied twice, except for LR2 whose single section already is the square.
+    auto numSections = slope == Slope::db12 ? 1 : (int) numQs * 2;
+    split.numSections = numSections;
+    combine.numSections = numSections;
+    highPass.numSections = numChannels < maxChannels ? 0 : numSections;
+
+    for (int i = 0; i < maxSections; ++i)
+    {
+        auto& s = split.sections[(size_t) i];
+        auto& c = combine.sections[(size_t) i];
+        auto& h = highPass.sections[(size_t) i];
+
+        // Lanes that carry no band pass their input through untouched.
+        for (size_t lane = 0; lane < (size_t) numLanes; ++lane)
+        {
+            s.setLane(lane, {});
+            c.setLane(lane, {});
+            h.setLane(lane, {});
+        }
+
+        if (i >= numSections)
+            continue;
+
+        auto Q = qs[(size_t) i % numQs];
+        auto allPass = slope == Slope::db12 ? makeFirstOrderAllPass(K2)
+                                            : i < (int) numQs ? makeAllPass(K2, Q) : Coefficients{};
+
+        // Even lanes carry the low side of each channel, odd lanes the high side.
+        for (size_t lane = 0; lane < (size_t) (2 * maxChannels); lane += 2)
+        {
+            s.setLane(lane, makeLowPass(K1, Q));
+            s.setLane(lane + 1, makeHighPass(K1, Q, invertHighPass));
+
+            c.setLane(lane, allPass);
+            c.setLane(lane + 1, makeLowPass(K2, Q));
+            h.setLane(lane + 1, makeHighPass(K2, Q, invertHighPass));
+        }
+
+        // Mono leaves the right channel lanes free, so HP2 moves into the combine stage.
+        if (numChannels < maxChannels)
+            c.setLane(3, makeHighPass(K2, Q, invertHighPass));
+    }
+}
+
+LinkwitzRileyCrossover::Vec LinkwitzRileyCrossover::processStage(const Stage& stage, Vec* z1, Vec* z2, Vec x) noexcept
+{
+    for (int i = 0; i < stage.numSections; ++i)
+    {
+        const auto& c = stage.sections[(size_t) i];
+
+        // Transposed direct form II, one filter per lane. z1 adds the feedback term last,
+        // which keeps it off the critical path until y is known.
+        auto y = c.b0 * x + z1[i];
+        z1[i] = c.b1 * x + z2[i] - c.a1 * y;
+        z2[i] = c.b2 * x - c.a2 * y;
+        x = y;
+    }
+
+    return x;
+}
+
+void LinkwitzRileyCrossover::process(const juce::AudioBuffer<float>& input, BandBuffers& bands, int numSamples)
+{
+    auto channels = juce::jmin(numChannels, input.getNumChannels());
+
+    for (auto& band : bands)
+        jassert(band.getNumChannels() >= channels && band.getNumSamples() >= numSamples);
+
+    if (channels < maxChannels)
+    {
+        if (channels == 0)
+            return;
+
+        auto* x = input.getReadPointer(0);
+        auto* low = bands[0].getWritePointer(0);
+        auto* mid = bands[1].getWritePointer(0);
+        auto* high = bands[2].getWritePointer(0);
+
+        for (int n = 0; n < numSamples; ++n)
+        {
+            auto sides = processStage(split, z1, z2, Vec::expand(x[n]));
+            auto y = processStage(combine, z1 + maxSections, z2 + maxSections, sides);
+
+            // Prepared for stereo, HP2 stays in its own register even when only one channel arrives.
+            low[n] = y.get(0);
+            mid[n] = y.get(1);
+            high[n] = highPass.numSections > 0 ? processStage(highPass, z1 + 2 * maxSections, z2 + 2 * maxSections, sides).get(1) : y.get(3);
+        }
+
+        return;
+    }
+
+    auto* left = input.getReadPointer(0);
+    auto* right = input.getReadPointer(1);
+
+    std::array<float*, numBands> first, second;
+    for (size_t b = 0; b < (size_t) numBands; ++b)
+    {
+        first[b] = bands[b].getWritePointer(0);
+        second[b] = bands[b].getWritePointer(1);
+    }
+
+    for (int n = 0; n < numSamples; ++n)
+    {
+        // Lane inserts go through memory, broadcasting and masking stays in registers.
+        auto frame = Vec::expand(left[n]) * leftLanes + Vec::expand(right[n]) * rightLanes;
+
+        auto sides = processStage(split, z1, z2, frame);
+        auto lowMid = processStage(combine, z1 + maxSections, z2 + maxSections, sides);
+        auto high = processStage(highPass, z1 + 2 * maxSections, z2 + 2 * maxSections, sides);
+
+        first[0][n] = lowMid.get(0);
+        second[0][n] = lowMid.get(2);
+        first[1][n] = lowMid.get(1);
+        second[1][n] = lowMid.get(3);
+        first[2][n] = high.get(1);
+        second[2][n] = high.get(3);
+    }
+
+    encodeMidSide(bands, numSamples);
+}
+
+void LinkwitzRileyCrossover::encodeMidSide(BandBuffers& bands, int numSamples) const
+{
+    for (size_t b = 0; b < (size_t) numBands; ++b)
+    {
+        if (!midSide[b])
+            continue;
+
+        // M = (L + R) / 2 and S = (L - R) / 2, computed in place as S = M - R.
+        auto* first = bands[b].getWritePointer(0);
+        auto* second = bands[b].getWritePointer(1);
+
+        juce::FloatVectorOperations::add(first, second, numSamples);
+        juce::FloatVectorOperations::multiply(first, 0.5f, numSamples);
+        juce::FloatVectorOperations::subtract(second, first, second, numSamples);
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "DspStateArena.h"
+
+/**
+    Three band Linkwitz-Riley crossover built from cascades of second order sections.
+
+    Filters that run on the same input share a SIMD register, one filter per lane.
+    For stereo the split stage holds LP1 and HP1 of both channels, the combine stage
+    AP2 and LP2 of both channels and a third register HP2 of both channels, so each
+    section costs three vector biquads per stereo frame. Mono needs no third register,
+    HP2 takes over a lane of the combine stage instead. Every register reads the output
+    of the one before it as is, so no lanes have to be shuffled per sample.
+
+    The cost still grows linearly with the number of sections, so LR8 costs about four
+    times as much as LR2. Packing only removes the idle and duplicated lanes.
+
+    Bands switched to mid/side are encoded after the filters, so a stereo band buffer
+    then holds M in channel 0 and S in channel 1.
+
+    The filter state lives in the processor's DspStateArena, bindState() has to be
+    called before prepare().
+*/
+class LinkwitzRileyCrossover
+{
+public:
+    enum class Slope
+    {
+        db12,
+        db24,
+        db48,
+    };
+
+    static constexpr int numBands = 3;
+    static constexpr int maxChannels = 2;
+    static constexpr int maxSections = 4;
+
+    using BandBuffers = std::array<juce::AudioBuffer<float>, numBands>;
+
+    LinkwitzRileyCrossover();
+
+    void bindState(DspStateArena& arena);
+    void prepare(const juce::dsp::ProcessSpec& spec);
+    void reset();
+
+    void setSlope(Slope newSlope);
+    void setCrossoverFrequencies(float lowMidFreq, float midHighFreq);
+    void setMidSide(int band, bool shouldEncodeMidSide);
+
+    /** Splits the first numSamples of input into the band buffers, which must hold at least that many samples. */
+    void process(const juce::AudioBuffer<float>& input, BandBuffers& bands, int numSamples);
+
+private:
+    using Vec = juce::dsp::SIMDRegister<float>;
+    static constexpr int numLanes = (int) Vec::SIMDNumElements;
+    static_assert(numLanes >= 2 * maxChannels, "both channels of a stage need their own SIMD lanes");
+
+    struct Coefficients
+    {
+        double b0 = 1, b1 = 0, b2 = 0, a1 = 0, a2 = 0;
+    };
+
+    struct Section
+    {
+        Vec b0, b1, b2, a1, a2;
+
+        void setLane(size_t lane, const Coefficients& c);
+    };
+
+    struct Stage
+    {
+        std::array<Section, maxSections> sections;
+        int numSections = 0;
+    };
+
+    static Coefficients makeLowPass(double K, double Q);
+    static Coefficients makeHighPass(double K, double Q, bool invert);
+    static Coefficients makeAllPass(double K, double Q);
+    static Coefficients makeFirstOrderAllPass(double K);
+
+    static Vec processStage(const Stage& stage, Vec* z1, Vec* z2, Vec x) noexcept;
+
+    void updateCoefficients();
+    void encodeMidSide(BandBuffers& bands, int numSamples) const;
+
+    // Lanes 0 to 3: split LP1 L, HP1 L, LP1 R, HP1 R; combine AP2 L, LP2 L, AP2 R, LP2 R
+    // (mono: AP2, LP2, -, HP2); highPass -, HP2 L, -, HP2 R.
+    Stage split, combine, highPass;
+
+    // Filter state, one array per state variable, maxSections entries per stage in the
+    // order split, combine, highPass.
+    Vec* z1{ nullptr };
+    Vec* z2{ nullptr };
+
+    // Masks that place the left channel in lanes 0 and 1 and the right channel in lanes 2 and 3.
+    Vec leftLanes, rightLanes;
+
+    std::array<bool, numBands> midSide{};
+
+    Slope slope{ Slope::db24 };
+    float lowMidCutoff{ 400.f }, midHighCutoff{ 2000.f };
+    double sampleRate{ 44100.0 };
+    int numChannels{ 0 };
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+    One aligned, contiguous allocation that holds all per-instance DSP state.
+
+    State is grouped by kind rather than by owner: all filter states sit next to
+    each other, then all envelopes, smoothers, meter histories and band scratch,
+    each region starting on its own cache line. Owners only keep pointers into it.
+    Inside a region every field has its own array: all z1 of the crossover sections and
+    then all z2, all detector envelopes and then all peaks, gains and steps. Fields of
+    only a few values share one region as consecutive arrays instead of each taking a
+    cache line of its own.
+
+    The layout is built in two passes over the same bind calls. The first pass
+    runs while measuring and only counts bytes, allocate() then sizes the block
+    exactly once, and the second pass hands out the real regions.
+*/
+class DspStateArena
+{
+public:
+    static constexpr size_t alignment = 64;
+
+    void beginMeasuring()
+    {
+        base = nullptr;
+        used = 0;
+    }
+
+    void allocate()
+    {
+        sizeInBytes = used;
+        storage.allocate(sizeInBytes + alignment, true);
+
+        auto address = reinterpret_cast<std::uintptr_t>(storage.get());
+        base = reinterpret_cast<char*>((address + alignment - 1) & ~(std::uintptr_t) (alignment - 1));
+        used = 0;
+    }
+
+    /** Returns the next region, or nullptr while the arena is only being measured. */
+    template<typename T>
+    T* take(size_t count)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "arena state must be plain data");
+        static_assert(alignof(T) <= alignment, "arena regions are only cache line aligned");
+
+        auto offset = (used + alignment - 1) & ~(alignment - 1);
+        used = offset + sizeof(T) * count;
+
+        if (base == nullptr)
+            return nullptr;
+
+        jassert(used <= sizeInBytes);
+        return reinterpret_cast<T*>(base + offset);
+    }
+
+    size_t getSizeInBytes() const { return sizeInBytes; }
+
+private:
+    juce::HeapBlock<char> storage;
+    char* base{ nullptr };
+    size_t used{ 0 }, sizeInBytes{ 0 };
+};
@@ -0,0 +1,197 @@
+#include "LoudnessMeter.h"
+
+namespace
+{
+    // BS.1770 K-weighting, the pre-filter shelf and the RLB high pass, redesigned for any sample rate.
+    constexpr double shelfFrequency = 1681.974450955533;
+    constexpr double shelfGainDb = 3.999843853973347;
+    constexpr double shelfQ = 0.7071752369554196;
+
+    constexpr double highPassFrequency = 38.13547087602444;
+    constexpr double highPassQ = 0.5003270373238773;
+}
+
+//==============================================================================
+void LoudnessMeter::bindState(DspStateArena& arena, int channels)
+{
+    // The four state arrays are only a few doubles each, so they share one region.
+    auto* filterState = arena.take<double>(4 * (size_t) channels);
+    auto offset = [filterState](int index) { return filterState == nullptr ? nullptr : filterState + index; };
+    shelfZ1 = offset(0);
+    shelfZ2 = offset(channels);
+    highPassZ1 = offset(2 * channels);
+    highPassZ2 = offset(3 * channels);
+    hopRing = arena.take<double>(shortTermHops);
+    histogram = arena.take<juce::uint32>(numBins);
+    histogramEnergy = arena.take<double>(numBins);
+}
+
+void LoudnessMeter::prepare(const juce::dsp::ProcessSpec& spec)
+{
+    jassert(spec.numChannels <= (juce::uint32) maxChannels);
+    numChannels = juce::jmin((int) spec.numChannels, maxChannels);
+    hopSize = juce::jmax(1, juce::roundToInt(spec.sampleRate * 0.1));
+
+    auto pi = juce::MathConstants<double>::pi;
+
+    {
+        auto K = std::tan(pi * shelfFrequency / spec.sampleRate);
+        auto Vh = std::pow(10.0, shelfGainDb / 20.0);
+        auto Vb = std::pow(Vh, 0.4996667741545416);
+        auto norm = 1.0 / (1.0 + K / shelfQ + K * K);
+
+        shelf.b0 = (Vh + Vb * K / shelfQ + K * K) * norm;
+        shelf.b1 = 2.0 * (K * K - Vh) * norm;
+        shelf.b2 = (Vh - Vb * K / shelfQ + K * K) * norm;
+        shelf.a1 = 2.0 * (K * K - 1.0) * norm;
+        shelf.a2 = (1.0 - K / shelfQ + K * K) * norm;
+    }
+
+    {
+        auto K = std::tan(pi * highPassFrequency / spec.sampleRate);
+        auto norm = 1.0 / (1.0 + K / highPassQ + K * K);
+
+        highPass.b0 = 1.0;
+        highPass.b1 = -2.0;
+        highPass.b2 = 1.0;
+        highPass.a1 = 2.0 * (K * K - 1.0) * norm;
+        highPass.a2 = (1.0 - K / highPassQ + K * K) * norm;
+    }
+
+    reset();
+}
+
+void LoudnessMeter::reset()
+{
+    if (shelfZ1 != nullptr)
+    {
+        for (auto* z : { shelfZ1, shelfZ2, highPassZ1, highPassZ2 })
+            std::fill(z, z + numChannels, 0.0);
+
+        std::fill(hopRing, hopRing + shortTermHops, 0.0);
+        std::fill(histogram, histogram + numBins, 0u);
+        std::fill(histogramEnergy, histogramEnergy + numBins, 0.0);
+    }
+
+    hopPosition = 0;
+    hopEnergy = 0;
+
+    ringIndex = 0;
+    hopsSeen = 0;
+
+    gatedEnergy = 0;
+    gatedBlocks = 0;
+
+    momentary = silence;
+    shortTerm = silence;
+    integrated = silence;
+}
+
+void LoudnessMeter::process(const juce::AudioBuffer<float>& buffer, int numSamples)
+{
+    auto channels = juce::jmin(numChannels, buffer.getNumChannels());
+    auto pos = 0;
+
+    while (pos < numSamples)
+    {
+        auto n = juce::jmin(numSamples - pos, hopSize - hopPosition);
+
+        for (int ch = 0; ch < channels; ++ch)
+        {
+            auto* x = buffer.getReadPointer(ch, pos);
+            auto s1z1 = shelfZ1[ch], s1z2 = shelfZ2[ch];
+            auto s2z1 = highPassZ1[ch], s2z2 = highPassZ2[ch];
+            auto energy = 0.0;
+
+            for (int i = 0; i < n; ++i)
+            {
+                auto in = (double) x[i];
+
+                auto y = shelf.b0 * in + s1z1;
+                s1z1 = shelf.b1 * in - shelf.a1 * y + s1z2;
+                s1z2 = shelf.b2 * in - shelf.a2 * y;
+
+                auto k = highPass.b0 * y + s2z1;
+                s2z1 = highPass.b1 * y - highPass.a1 * k + s2z2;
+                s2z2 = highPass.b2 * y - highPass.a2 * k;
+
+                energy += k * k;
+            }
+
+            shelfZ1[ch] = s1z1;
+            shelfZ2[ch] = s1z2;
+            highPassZ1[ch] = s2z1;
+            highPassZ2[ch] = s2z2;
+
+            // Left and right both carry a channel weight of 1.0.
+            hopEnergy += energy;
+        }
+
+        hopPosition += n;
+        pos += n;
+
+        if (hopPosition == hopSize)
+            finishHop();
+    }
+}
+
+double LoudnessMeter::energyToLoudness(double meanSquare)
+{
+    return meanSquare > 0.0 ? -0.691 + 10.0 * std::log10(meanSquare) : (double) silence;
+}
+
+void LoudnessMeter::finishHop()
+{
+    hopRing[ringIndex] = hopEnergy / hopSize;
+    hopEnergy = 0;
+    hopPosition = 0;
+    ++hopsSeen;
+
+    auto sumLastHops = [this](int count)
+    {
+        auto sum = 0.0;
+        for (int i = 0; i < count; ++i)
+            sum += hopRing[(ringIndex - i + shortTermHops) % shortTermHops];
+        return sum / count;
+    };
+
+    auto momentaryEnergy = sumLastHops(momentaryHops);
+    momentary = (float) juce::jmax((double) silence, energyToLoudness(momentaryEnergy));
+    shortTerm = (float) juce::jmax((double) silence, energyToLoudness(sumLastHops(shortTermHops)));
+
+    ringIndex = (ringIndex + 1) % shortTermHops;
+
+    // Every hop completes a 400 ms gating block overlapping the previous one by 75%.
+    if (hopsSeen < momentaryHops)
+        return;
+
+    auto blockLoudness = energyToLoudness(momentaryEnergy);
+    if (blockLoudness <= absoluteGate)
+        return;
+
+    auto bin = juce::jlimit(0, numBins - 1, (int) ((blockLoudness - absoluteGate) * binsPerLU));
+    ++histogram[bin];
+    histogramEnergy[bin] += momentaryEnergy;
+    gatedEnergy += momentaryEnergy;
+    ++gatedBlocks;
+
+    updateIntegrated();
+}
+
+void LoudnessMeter::updateIntegrated()
+{
+    auto threshold = energyToLoudness(gatedEnergy / (double) gatedBlocks) + relativeGate;
+    auto firstBin = juce::jlimit(0, numBins - 1, (int) ((threshold - absoluteGate) * binsPerLU));
+
+    auto energy = 0.0;
+    juce::int64 count = 0;
+
+    for (auto i = firstBin; i < numBins; ++i)
+    {
+        energy += histogramEnergy[i];
+        count += histogram[i];
+    }
+
+    if (count > 0)
+        integrated = (float) energyToLoudness(energy / (double) count);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "DspStateArena.h"
+
+/**
+    EBU R128 / ITU-R BS.1770 loudness meter.
+
+    The signal is K-weighted and summed into 100 ms hops. Momentary (400 ms) and
+    short-term (3 s) loudness are read off a ring of hop energies, and every
+    400 ms gating block lands in a fixed 0.1 LU histogram that keeps the block
+    count and energy of each bin. The gated integrated loudness is re-evaluated
+    from that histogram once per hop, so processing does a bounded amount of
+    work per block and never allocates.
+
+    The filter states, hop ring and histogram live in the processor's DspStateArena,
+    bindState() has to be called before prepare(). The results are published
+    through atomics and can be read from any thread.
+*/
+class LoudnessMeter
+{
+public:
+    static constexpr int maxChannels = 2;
+    static constexpr float silence = -100.f;
+
+    void bindState(DspStateArena& arena, int channels);
+    void prepare(const juce::dsp::ProcessSpec& spec);
+    void reset();
+
+    void process(const juce::AudioBuffer<float>& buffer, int numSamples);
+
+    float getMomentaryLoudness() const { return momentary.load(); }
+    float getShortTermLoudness() const { return shortTerm.load(); }
+    float getIntegratedLoudness() const { return integrated.load(); }
+
+    /** True once at least one gating block has passed the absolute gate. */
+    bool hasIntegratedLoudness() const { return integrated.load() > silence; }
+
+private:
+    struct Biquad
+    {
+        double b0 = 1, b1 = 0, b2 = 0, a1 = 0, a2 = 0;
+    };
+
+    static constexpr int momentaryHops = 4;
+    static constexpr int shortTermHops = 30;
+
+    static constexpr double absoluteGate = -70.0;
+    static constexpr double relativeGate = -10.0;
+    static constexpr double histogramTop = 10.0;
+    static constexpr double binsPerLU = 10.0;
+    static constexpr int numBins = (int) ((histogramTop - absoluteGate) * binsPerLU);
+
+    static double energyToLoudness(double meanSquare);
+
+    void finishHop();
+    void updateIntegrated();
+
+    Biquad shelf, highPass;
+
+    // K-weighting filter state, one array per state variable with an entry per channel.
+    double* shelfZ1{ nullptr };
+    double* shelfZ2{ nullptr };
+    double* highPassZ1{ nullptr };
+    double* highPassZ2{ nullptr };
+
+    int numChannels{ 0 };
+    int hopSize{ 4410 };
+    int hopPosition{ 0 };
+    double hopEnergy{ 0 };
+
+    double* hopRing{ nullptr };
+    int ringIndex{ 0 };
+    juce::int64 hopsSeen{ 0 };
+
+    juce::uint32* histogram{ nullptr };
+    double* histogramEnergy{ nullptr };
+    double gatedEnergy{ 0 };
+    juce::int64 gatedBlocks{ 0 };
+
+    std::atomic<float> momentary{ silence }, shortTerm{ silence }, integrated{ silence };
+};
@@ -63,23 +63,22 @@ MultiBandCompressorAudioProcessor::MultiBandCompressorAudioProcessor()
     boolHelper(midBandComp.solo,        Names::solo_mid_band);
     boolHelper(highBandComp.solo,       Names::solo_high_band);
 
+    choiceHelper(lowBandComp.channelMode,  Names::channel_mode_low_band);
+    choiceHelper(midBandComp.channelMode,  Names::channel_mode_mid_band);
+    choiceHelper(highBandComp.channelMode, Names::channel_mode_high_band);
+
     floatHelper(lowMidCrossover,        Names::low_mid_crossover_freq);
     floatHelper(midHighCrossover,       Names::mid_high_crossover_freq);
+    choiceHelper(crossoverSlope,        Names::crossover_slope);
 
     floatHelper(inputGainParam,         Names::Gain_In);
     floatHelper(outputGainParam,        Names::Gain_Out);
 
-    LP1.setType(juce::dsp::LinkwitzRileyFilterType::lowpass);
-    HP1.setType(juce::dsp::LinkwitzRileyFilterType::highpass);
-
-    AP2.setType(juce::dsp::LinkwitzRileyFilterType::allpass);
-
-    LP2.setType(juce::dsp::LinkwitzRileyFilterType::lowpass);
-    HP2.setType(juce::dsp::LinkwitzRileyFilterType::highpass);
-
-    //invAP1.setType(juce::dsp::LinkwitzRileyFilterType::allpass);
-    //invAP2.setType(juce::dsp::LinkwitzRileyFilterType::allpass);
+    boolHelper(autoMakeupParam,         Names::auto_makeup);
+    floatHelper(targetLoudnessParam,    Names::target_loudness);
 
+    boolHelper(limiterParam,            Names::true_peak_limiter);
+    floatHelper(ceilingParam,           Names::true_peak_ceiling);
 }
 
 MultiBandCompressorAudioProcessor::~MultiBandCompressorAudioProcessor()
@@ -159,32 +158,66 @@ void MultiBandCompressorAudioProcessor::prepareToPlay (double sampleRate, int sa
     spec.numChannels = getNumOutputChannels();
     spec.sampleRate = sampleRate;
 
-    for (auto& comp : compressors)
-        comp.prepare(spec);
-
-    LP1.prepare(spec);
-    HP1.prepare(spec);
+    numPreparedChannels = juce::jmin((int) spec.numChannels, LinkwitzRileyCrossover::maxChannels);
+    maxBlockSize = juce::jmax(1, samplesPerBlock);
 
-    AP2.prepare(spec);
+    // The bind pass runs twice: the first one sizes the arena, the second one hands out its regions.
+    arena.beginMeasuring();
+    bindDspState(spec);
+    arena.allocate();
+    bindDspState(spec);
 
-    LP2.prepare(spec);
-    HP2.prepare(spec);
+    for (auto& comp : compressors)
+        comp.prepare(spec);
 
-  /*  invAP1.prepare(spec);
-    invAP2.prepare(spec);
+    crossover.prepare(spec);
 
-    invAPBuffer.setSize(spec.numChannels, samplesPerBlock);*/
+    makeupLoudness.prepare(spec);
+    outputLoudness.prepare(spec);
+    updateAutoMakeupMode();
 
-    inputGain.prepare(spec);
-    outputGain.prepare(spec);
+    // The gains start where the parameters, or the last auto makeup, left them. Ramping up from
+    // unity would play everything too hot for the length of the ramp after every re-prepare.
+    inputGain.reset(sampleRate, 0.05, inputGainParam->get());
+    outputGain.reset(sampleRate, 0.05, autoMakeupEnabled && hasMakeupGain ? makeupDecibels : outputGainParam->get());
 
-    inputGain.setRampDurationSeconds(0.05);
-    outputGain.setRampDurationSeconds(0.05);
+    limiter.prepare(spec);
+    updateLimiter();
+    setLatencySamples(limiter.getLatencySamples());
+}
 
-    for (auto& buffer : filterBuffers)
-    {
-        buffer.setSize(spec.numChannels, samplesPerBlock);
-    }
+void MultiBandCompressorAudioProcessor::bindDspState(const juce::dsp::ProcessSpec& spec)
+{
+    auto channels = (size_t) numPreparedChannels;
+    auto offset = [](auto* region, size_t index) { return region == nullptr ? nullptr : region + index; };
+
+    // Filter states
+    crossover.bindState(arena);
+
+    // Detectors: envelopes, peaks, gains and steps as consecutive arrays in one region, each
+    // holding one row of channels per band. They are too small to pad each to a cache line.
+    auto numDetectors = compressors.size() * channels;
+    auto* detectors = arena.take<float>(4 * numDetectors);
+    for (size_t i = 0; i < compressors.size(); ++i)
+        compressors[i].bindState(offset(detectors, i * channels), offset(detectors, numDetectors + i * channels),
+                                 offset(detectors, 2 * numDetectors + i * channels), offset(detectors, 3 * numDetectors + i * channels));
+
+    // Smoothers: current gains, targets and steps as consecutive arrays, input gain first,
+    // then the remaining ramp lengths
+    auto* ramps = arena.take<float>(3 * 2);
+    auto* rampRemaining = arena.take<int>(2);
+    inputGain.bindState(offset(ramps, 0), offset(ramps, 2), offset(ramps, 4), offset(rampRemaining, 0));
+    outputGain.bindState(offset(ramps, 1), offset(ramps, 3), offset(ramps, 5), offset(rampRemaining, 1));
+
+    // Meter histories
+    makeupLoudness.bindState(arena, numPreparedChannels);
+    outputLoudness.bindState(arena, numPreparedChannels);
+
+    // Limiter delay lines and detector history
+    limiter.bindState(arena, spec);
+
+    // Band scratch, band-major then channel-major
+    bandScratch = arena.take<float>(filterBuffers.size() * channels * (size_t) maxBlockSize);
 }
 
 void MultiBandCompressorAudioProcessor::releaseResources()
@@ -221,45 +254,83 @@ bool MultiBandCompressorAudioProcessor::isBusesLayoutSupported (const BusesLayou
 
 void MultiBandCompressorAudioProcessor::updateState()
 {
-    for (auto& compressor : compressors)
-        compressor.updateCompressorSettings();
+    // Nothing in the low band needs a full rate detector, its decimation follows the low-mid crossover.
+    lowBandComp.setDetectorDecimation(CompressorBand::detectorDecimationFor(getSampleRate(), lowMidCrossover->get()));
 
-    auto lowMidCutOffFreq = lowMidCrossover->get();
-    LP1.setCutoffFrequency(lowMidCutOffFreq);
-    HP1.setCutoffFrequency(lowMidCutOffFreq);
+    for (size_t i = 0; i < compressors.size(); ++i)
+    {
+        auto& compressor = compressors[i];
+        compressor.updateCompressorSettings();
+        crossover.setMidSide((int) i, compressor.isMidSide());
+    }
 
-    auto midHighCutOffFreq = midHighCrossover->get();
-    AP2.setCutoffFrequency(midHighCutOffFreq);
-    LP2.setCutoffFrequency(midHighCutOffFreq);
-    HP2.setCutoffFrequency(midHighCutOffFreq);
+    crossover.setSlope(static_cast<LinkwitzRileyCrossover::Slope>(crossoverSlope->getIndex()));
+    crossover.setCrossoverFrequencies(lowMidCrossover->get(), midHighCrossover->get());
 
     inputGain.setGainDecibels(inputGainParam->get());
-    outputGain.setGainDecibels(outputGainParam->get());
+
+    updateAutoMakeupMode();
+
+    if (!autoMakeupEnabled)
+        outputGain.setGainDecibels(outputGainParam->get());
+
+    updateLimiter();
 }
 
-void MultiBandCompressorAudioProcessor::splitBands(const juce::AudioBuffer<float>& inputBuffer)
+void MultiBandCompressorAudioProcessor::updateAutoMakeupMode()
+{
+    if (autoMakeupParam->get() == autoMakeupEnabled)
+        return;
+
+    // Every time auto makeup is switched on it measures from scratch, material that played
+    // while it was off must not decide the gain.
+    autoMakeupEnabled = autoMakeupParam->get();
+    if (autoMakeupEnabled)
+    {
+        makeupLoudness.reset();
+        hasMakeupGain = false;
+    }
+}
+
+void MultiBandCompressorAudioProcessor::updateLimiter()
+{
+    limiter.setCeilingDecibels(ceilingParam->get());
+    limiter.setEnabled(limiterParam->get());
+}
+
+void MultiBandCompressorAudioProcessor::updateAutoMakeup(const juce::AudioBuffer<float>& buffer)
 {
-    for (auto& fb : filterBuffers)
+    makeupLoudness.process(buffer, buffer.getNumSamples());
+
+    // Until the first gating block is in there is nothing to match. Hold the makeup from before
+    // a re-prepare if there is one, the manual gain otherwise.
+    if (!makeupLoudness.hasIntegratedLoudness())
     {
-        fb = inputBuffer;
+        outputGain.setGainDecibels(hasMakeupGain ? makeupDecibels : outputGainParam->get());
+        return;
     }
 
-    auto fb0Block = juce::dsp::AudioBlock<float>(filterBuffers[0]);
-    auto fb1Block = juce::dsp::AudioBlock<float>(filterBuffers[1]);
-    auto fb2Block = juce::dsp::AudioBlock<float>(filterBuffers[2]);
+    const auto& range = outputGainParam->range;
+    makeupDecibels = juce::jlimit(range.start, range.end, targetLoudnessParam->get() - makeupLoudness.getIntegratedLoudness());
+    hasMakeupGain = true;
+    outputGain.setGainDecibels(makeupDecibels);
+}
 
-    auto fb0Ctx = juce::dsp::ProcessContextReplacing<float>(fb0Block);
-    auto fb1Ctx = juce::dsp::ProcessContextReplacing<float>(fb1Block);
-    auto fb2Ctx = juce::dsp::ProcessContextReplacing<float>(fb2Block);
+void MultiBandCompressorAudioProcessor::splitBands(const juce::AudioBuffer<float>& inputBuffer)
+{
+    auto numSamples = inputBuffer.getNumSamples();
+    jassert(numSamples <= maxBlockSize);
 
-    LP1.process(fb0Ctx);
-    AP2.process(fb0Ctx);
+    for (size_t i = 0; i < filterBuffers.size(); ++i)
+    {
+        std::array<float*, LinkwitzRileyCrossover::maxChannels> channels{};
+        for (int ch = 0; ch < numPreparedChannels; ++ch)
+            channels[(size_t) ch] = bandScratch + (i * (size_t) numPreparedChannels + (size_t) ch) * (size_t) maxBlockSize;
 
-    HP1.process(fb1Ctx);
-    filterBuffers[2] = filterBuffers[1];
-    LP2.process(fb1Ctx);
+        filterBuffers[i].setDataToReferTo(channels.data(), numPreparedChannels, numSamples);
+    }
 
-    HP2.process(fb2Ctx);
+    crossover.process(inputBuffer, filterBuffers, numSamples);
 }
 
 void MultiBandCompressorAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
@@ -278,9 +349,21 @@ void MultiBandCompressorAudioProcessor::processBlock (juce::AudioBuffer<float>&
         buffer.clear (i, 0, buffer.getNumSamples());
 
     updateState();
-    
-    applyGain(buffer, inputGain);
-    
+
+    // The band scratch holds maxBlockSize samples, so larger host blocks are processed in slices.
+    auto totalNumSamples = buffer.getNumSamples();
+    for (auto start = 0; start < totalNumSamples; start += maxBlockSize)
+    {
+        auto sliceLength = juce::jmin(maxBlockSize, totalNumSamples - start);
+        juce::AudioBuffer<float> slice(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), start, sliceLength);
+        processSlice(slice);
+    }
+}
+
+void MultiBandCompressorAudioProcessor::processSlice(juce::AudioBuffer<float>& buffer)
+{
+    inputGain.process(buffer);
+
     splitBands(buffer);
 
     for (size_t i = 0; i < filterBuffers.size(); i++)
@@ -289,12 +372,27 @@ void MultiBandCompressorAudioProcessor::processBlock (juce::AudioBuffer<float>&
     }
 
     auto numSamples = buffer.getNumSamples();
-    auto numChannels = buffer.getNumChannels();
+    auto numChannels = juce::jmin(buffer.getNumChannels(), numPreparedChannels);
 
     buffer.clear();
 
-    auto addFilterBand = [nc = numChannels, ns = numSamples](auto& inputBuffer, const auto& source)
+    auto addFilterBand = [nc = numChannels, ns = numSamples](auto& inputBuffer, const auto& source, bool isMidSide)
     {
+        if (isMidSide && nc == 2)
+        {
+            // Mid/side decode, fused into the band sum: L = M + S, R = M - S.
+            auto* left = inputBuffer.getWritePointer(0);
+            auto* right = inputBuffer.getWritePointer(1);
+            auto* mid = source.getReadPointer(0);
+            auto* side = source.getReadPointer(1);
+
+            juce::FloatVectorOperations::add(left, mid, ns);
+            juce::FloatVectorOperations::add(left, side, ns);
+            juce::FloatVectorOperations::add(right, mid, ns);
+            juce::FloatVectorOperations::subtract(right, side, ns);
+            return;
+        }
+
         for (auto i = 0; i < nc; ++i)
         {
             inputBuffer.addFrom(i, 0, source, i, 0, ns);
@@ -318,7 +416,7 @@ void MultiBandCompressorAudioProcessor::processBlock (juce::AudioBuffer<float>&
             auto& comp = compressors[i];
             if (comp.solo->get())
             {
-                addFilterBand(buffer, filterBuffers[i]);
+                addFilterBand(buffer, filterBuffers[i], comp.isMidSide());
             }
         }   
     }
@@ -327,14 +425,21 @@ void MultiBandCompressorAudioProcessor::processBlock (juce::AudioBuffer<float>&
         for (size_t i = 0; i < compressors.size(); ++i)
         {
             auto& comp = compressors[i];
-            if (!comp.mute->get());
+            if (!comp.mute->get())
             {
-                addFilterBand(buffer, filterBuffers[i]);
+                addFilterBand(buffer, filterBuffers[i], comp.isMidSide());
             }
         }
     }
 
-    applyGain(buffer, outputGain);
+    if (autoMakeupEnabled)
+        updateAutoMakeup(buffer);
+
+    outputGain.process(buffer);
+
+    limiter.process(buffer);
+
+    outputLoudness.process(buffer, numSamples);
 }
 
 //==============================================================================
@@ -522,6 +627,27 @@ juce::AudioProcessorValueTreeState::ParameterLayout MultiBandCompressorAudioProc
         false
     ));
 
+    // CHANNEL MODE
+    auto channelModeChoices = StringArray{ "Unlinked", "Linked", "Mid/Side" };
+    layout.add(std::make_unique<AudioParameterChoice>(
+        params.at(Names::channel_mode_low_band),
+        params.at(Names::channel_mode_low_band),
+        channelModeChoices,
+        0
+    ));
+    layout.add(std::make_unique<AudioParameterChoice>(
+        params.at(Names::channel_mode_mid_band),
+        params.at(Names::channel_mode_mid_band),
+        channelModeChoices,
+        0
+    ));
+    layout.add(std::make_unique<AudioParameterChoice>(
+        params.at(Names::channel_mode_high_band),
+        params.at(Names::channel_mode_high_band),
+        channelModeChoices,
+        0
+    ));
+
     // CUT OFF FREQUENCIES
     layout.add(std::make_unique<AudioParameterFloat>(
         params.at(Names::low_mid_crossover_freq),
@@ -535,6 +661,12 @@ juce::AudioProcessorValueTreeState::ParameterLayout MultiBandCompressorAudioProc
         NormalisableRange<float>(1000, 20000, 1, 1),
         2000
     ));
+    layout.add(std::make_unique<AudioParameterChoice>(
+        params.at(Names::crossover_slope),
+        params.at(Names::crossover_slope),
+        StringArray{ "12 dB/Oct", "24 dB/Oct", "48 dB/Oct" },
+        1
+    ));
 
     // GAIN
     auto gainRange = NormalisableRange<float>(-24.f, 24.f, 0.5f, 1.f);
@@ -551,6 +683,31 @@ juce::AudioProcessorValueTreeState::ParameterLayout MultiBandCompressorAudioProc
         0
     ));
 
+    // LOUDNESS
+    layout.add(std::make_unique<AudioParameterBool>(
+        params.at(Names::auto_makeup),
+        params.at(Names::auto_makeup),
+        false
+    ));
+    layout.add(std::make_unique<AudioParameterFloat>(
+        params.at(Names::target_loudness),
+        params.at(Names::target_loudness),
+        NormalisableRange<float>(-36.f, 0.f, 0.5f, 1.f),
+        -23.f
+    ));
+
+    // TRUE PEAK LIMITER
+    layout.add(std::make_unique<AudioParameterBool>(
+        params.at(Names::true_peak_limiter),
+        params.at(Names::true_peak_limiter),
+        false
+    ));
+    layout.add(std::make_unique<AudioParameterFloat>(
+        params.at(Names::true_peak_ceiling),
+        params.at(Names::true_peak_ceiling),
+        NormalisableRange<float>(-12.f, 0.f, 0.1f, 1.f),
+        -1.f
+    ));
 
     return layout;
 }
\ No newline at end of file
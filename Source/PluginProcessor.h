@@ -1,6 +1,10 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "Crossover.h"
+#include "LoudnessMeter.h"
+#include "TruePeakLimiter.h"
+#include "DspStateArena.h"
 
 namespace Params
 {
@@ -8,6 +12,7 @@ namespace Params
     {
         low_mid_crossover_freq,
         mid_high_crossover_freq,
+        crossover_slope,
 
         threshold_low_band,
         threshold_mid_band,
@@ -37,8 +42,18 @@ namespace Params
         solo_mid_band,
         solo_high_band,
 
+        channel_mode_low_band,
+        channel_mode_mid_band,
+        channel_mode_high_band,
+
         Gain_In,
         Gain_Out,
+
+        auto_makeup,
+        target_loudness,
+
+        true_peak_limiter,
+        true_peak_ceiling,
     };
 
     inline const std::map<Names, juce::String>& GetParams()
@@ -47,6 +62,7 @@ namespace Params
         {
             {low_mid_crossover_freq, "Low-Mid Crossover Freq"},
             {mid_high_crossover_freq, "Mid-High Crossover Freq"},
+            {crossover_slope, "Crossover Slope"},
 
             {threshold_low_band, "Threshold Low Band"},
             {threshold_mid_band, "Threshold Mid Band"},
@@ -76,8 +92,18 @@ namespace Params
             {solo_mid_band, "Solo Mid Band"},
             {solo_high_band, "Solo High Band"},
 
+            {channel_mode_low_band, "Channel Mode Low Band"},
+            {channel_mode_mid_band, "Channel Mode Mid Band"},
+            {channel_mode_high_band, "Channel Mode High Band"},
+
             {Gain_In, "Gain In"},
             {Gain_Out, "Gain_Out"},
+
+            {auto_makeup, "Auto Makeup"},
+            {target_loudness, "Target Loudness"},
+
+            {true_peak_limiter, "True Peak Limiter"},
+            {true_peak_ceiling, "True Peak Ceiling"},
         };
 
         return params;
@@ -86,6 +112,15 @@ namespace Params
 
 struct CompressorBand
 {
+    enum class ChannelMode
+    {
+        unlinked,
+        linked,
+        midSide,
+    };
+
+    static constexpr int maxChannels = LinkwitzRileyCrossover::maxChannels;
+
     juce::AudioParameterFloat* attack{ nullptr };
     juce::AudioParameterFloat* release{ nullptr };
     juce::AudioParameterFloat* threshold{ nullptr };
@@ -93,32 +128,318 @@ struct CompressorBand
     juce::AudioParameterBool* bypassed{ nullptr };
     juce::AudioParameterBool* mute{ nullptr };
     juce::AudioParameterBool* solo{ nullptr };
+    juce::AudioParameterChoice* channelMode{ nullptr };
+
+    static constexpr int maxDecimation = 16;
+
+    /**
+        Picks the largest power of two decimation, up to maxDecimation, that keeps the
+        detector's control rate at least eight times above the highest frequency in the band.
+    */
+    static int detectorDecimationFor(double sampleRate, float highestFrequency)
+    {
+        auto factor = 1;
+        while (factor < maxDecimation && sampleRate / (factor * 2) >= 8.0 * highestFrequency)
+            factor *= 2;
+
+        return factor;
+    }
+
+    /**
+        Points the band at its detector state inside the processor's state arena, one array
+        per field with one entry per channel. The peaks, gains and steps are only used by
+        the decimated path: the input peak since the last control tick, and the gain ramp
+        interpolating between control rate gains.
+    */
+    void bindState(float* channelEnvelopes, float* channelPeaks, float* channelGains, float* channelSteps)
+    {
+        envelopes = channelEnvelopes;
+        peaks = channelPeaks;
+        gains = channelGains;
+        steps = channelSteps;
+    }
 
     void prepare(const juce::dsp::ProcessSpec& spec)
     {
-        compressor.prepare(spec);
+        sampleRate = spec.sampleRate;
+        numChannels = juce::jmin((int) spec.numChannels, maxChannels);
+        std::fill(envelopes, envelopes + numChannels, 0.f);
+        std::fill(peaks, peaks + numChannels, 0.f);
+        std::fill(gains, gains + numChannels, 1.f);
+        std::fill(steps, steps + numChannels, 0.f);
+        countdown = 1;
+    }
+
+    /** Runs the detector and gain computer once every factor samples, see processDecimated(). */
+    void setDetectorDecimation(int factor)
+    {
+        jassert(factor >= 1 && factor <= maxDecimation);
+        if (factor == decimation)
+            return;
+
+        decimation = factor;
+        resyncDetectors();
     }
 
     void updateCompressorSettings()
     {
-        compressor.setAttack(attack->get());
-        compressor.setRelease(release->get());
-        compressor.setThreshold(threshold->get());
-        compressor.setRatio(ratio->getCurrentChoiceName().getFloatValue());
+        attackCoeff = ballisticsCoefficient(attack->get(), sampleRate);
+        releaseCoeff = ballisticsCoefficient(release->get(), sampleRate);
+        controlAttackCoeff = ballisticsCoefficient(attack->get(), sampleRate / decimation);
+        controlReleaseCoeff = ballisticsCoefficient(release->get(), sampleRate / decimation);
+        thresholdGain = juce::Decibels::decibelsToGain(threshold->get());
+        thresholdInverse = 1.f / thresholdGain;
+        // Parsing the choice name builds a String, so only do it when the choice actually changes.
+        if (ratio->getIndex() != ratioIndex)
+        {
+            ratioIndex = ratio->getIndex();
+            ratioInverse = 1.f / ratio->getCurrentChoiceName().getFloatValue();
+        }
+
+        auto newMode = static_cast<ChannelMode>(channelMode->getIndex());
+        if (newMode != mode)
+        {
+            // Linked mode only runs the first detector, the others carry on from it when it is left.
+            if (mode == ChannelMode::linked && numChannels > 1)
+            {
+                std::fill(envelopes + 1, envelopes + numChannels, envelopes[0]);
+                std::fill(peaks + 1, peaks + numChannels, peaks[0]);
+            }
+
+            mode = newMode;
+            resyncDetectors();
+        }
+    }
+
+    /** Mid/side bands arrive from the crossover encoded and have to be decoded when summed. */
+    bool isMidSide() const { return mode == ChannelMode::midSide && numChannels == maxChannels; }
+
+    void process(juce::AudioBuffer<float>& buffer)
+    {
+        if (bypassed->get())
+            return;
+
+        auto channels = juce::jmin(numChannels, buffer.getNumChannels());
+        auto numSamples = buffer.getNumSamples();
+        auto linked = mode == ChannelMode::linked && channels > 1;
+
+        if (decimation > 1)
+        {
+            processDecimated(buffer, channels, linked);
+            return;
+        }
+
+        if (linked)
+        {
+            // One detector and one gain computer for the whole band, applied to every channel.
+            auto* left = buffer.getWritePointer(0);
+            auto* right = buffer.getWritePointer(1);
+            auto& env = envelopes[0];
+
+            for (int n = 0; n < numSamples; ++n)
+            {
+                auto gain = computeGain(detect(env, juce::jmax(std::abs(left[n]), std::abs(right[n]))));
+                left[n] *= gain;
+                right[n] *= gain;
+            }
+
+            return;
+        }
+
+        // Unlinked and mid/side both detect per channel, mid/side just sees M and S instead of L and R.
+        for (int ch = 0; ch < channels; ++ch)
+        {
+            auto* samples = buffer.getWritePointer(ch);
+            auto& env = envelopes[ch];
+
+            for (int n = 0; n < numSamples; ++n)
+                samples[n] *= computeGain(detect(env, std::abs(samples[n])));
+        }
+    }
+
+private:
+    /**
+        Restarts the decimated gain ramps from the current envelopes. Ramps computed for
+        another mode or control period would otherwise run on until the next control tick.
+    */
+    void resyncDetectors()
+    {
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            gains[ch] = computeGain(envelopes[ch]);
+            steps[ch] = 0.f;
+        }
+
+        countdown = 1;
+    }
+
+    /**
+        Multirate path for bands without high frequency content. Each channel only tracks
+        its input peak at audio rate. Every decimation samples the ballistics run once on that
+        peak with control rate coefficients, the gain computer produces the next gain, and the
+        applied gain ramps linearly towards it over the following control period.
+    */
+    void processDecimated(juce::AudioBuffer<float>& buffer, int channels, bool linked)
+    {
+        auto numSamples = buffer.getNumSamples();
+        auto numDetectors = linked ? 1 : channels;
+
+        for (auto pos = 0; pos < numSamples;)
+        {
+            auto run = juce::jmin(numSamples - pos, countdown);
+
+            for (int ch = 0; ch < channels; ++ch)
+            {
+                auto d = linked ? 0 : ch;
+                auto* samples = buffer.getWritePointer(ch, pos);
+                auto peak = peaks[d];
+                auto gain = gains[d];
+                auto step = steps[d];
+
+                for (int n = 0; n < run; ++n)
+                {
+                    peak = juce::jmax(peak, std::abs(samples[n]));
+                    gain += step;
+                    samples[n] *= gain;
+                }
+
+                peaks[d] = peak;
+
+                // Linked channels share one ramp, so it only advances after the last of them.
+                if (!linked || ch == channels - 1)
+                    gains[d] = gain;
+            }
+
+            pos += run;
+            countdown -= run;
+
+            if (countdown == 0)
+            {
+                for (int d = 0; d < numDetectors; ++d)
+                {
+                    auto target = computeGain(detect(envelopes[d], peaks[d], controlAttackCoeff, controlReleaseCoeff));
+                    steps[d] = (target - gains[d]) / (float) decimation;
+                    peaks[d] = 0.f;
+                }
+
+                countdown = decimation;
+            }
+        }
+    }
+
+    // Same peak ballistics and gain law as juce::dsp::Compressor, so existing settings sound the same.
+    static float ballisticsCoefficient(float timeMs, double rate)
+    {
+        if (timeMs < 1.0e-3f)
+            return 0.f;
+
+        auto expFactor = -2.0 * juce::MathConstants<double>::pi * 1000.0 / rate;
+        return (float) std::exp(expFactor / timeMs);
+    }
+
+    float detect(float& env, float level) const noexcept
+    {
+        return detect(env, level, attackCoeff, releaseCoeff);
+    }
+
+    static float detect(float& env, float level, float attackCte, float releaseCte) noexcept
+    {
+        auto cte = level > env ? attackCte : releaseCte;
+        env = level + cte * (env - level);
+        return env;
+    }
+
+    float computeGain(float env) const noexcept
+    {
+        return env < thresholdGain ? 1.f : std::pow(env * thresholdInverse, ratioInverse - 1.f);
+    }
+
+    double sampleRate{ 44100.0 };
+    int numChannels{ 0 };
+    ChannelMode mode{ ChannelMode::unlinked };
+
+    float attackCoeff{ 0.f }, releaseCoeff{ 0.f };
+    float controlAttackCoeff{ 0.f }, controlReleaseCoeff{ 0.f };
+    float thresholdGain{ 1.f }, thresholdInverse{ 1.f }, ratioInverse{ 1.f };
+    int ratioIndex{ -1 };
+
+    int decimation{ 1 };
+    int countdown{ 1 };
+
+    float* envelopes{ nullptr };
+    float* peaks{ nullptr };
+    float* gains{ nullptr };
+    float* steps{ nullptr };
+};
+
+/** Linear gain ramp like juce::dsp::Gain, with the smoother state kept in the processor's arena. */
+struct RampedGain
+{
+    /** Points the ramp at its entry in each of the arena's smoother arrays, one array per field. */
+    void bindState(float* currentGain, float* targetGain, float* gainStep, int* remainingSamples)
+    {
+        current = currentGain;
+        target = targetGain;
+        step = gainStep;
+        remaining = remainingSamples;
+    }
+
+    /**
+        Starts on gainDb without ramping. juce::dsp::Gain::reset() keeps its target instead,
+        here the arena is reallocated by prepareToPlay, so the caller passes the gain to resume on.
+    */
+    void reset(double sampleRate, double rampDurationSeconds, float gainDb)
+    {
+        rampLength = juce::jmax(1, (int) std::floor(rampDurationSeconds * sampleRate));
+
+        *current = *target = juce::Decibels::decibelsToGain(gainDb);
+        *step = 0.f;
+        *remaining = 0;
+    }
+
+    void setGainDecibels(float gainDb)
+    {
+        auto newTarget = juce::Decibels::decibelsToGain(gainDb);
+        if (newTarget == *target)
+            return;
+
+        *target = newTarget;
+        *step = (newTarget - *current) / (float) rampLength;
+        *remaining = rampLength;
     }
 
     void process(juce::AudioBuffer<float>& buffer)
     {
-        auto block = juce::dsp::AudioBlock<float>(buffer);
-        auto context = juce::dsp::ProcessContextReplacing<float>(block);
+        auto numSamples = buffer.getNumSamples();
+        auto ramped = juce::jmin(numSamples, *remaining);
+
+        if (ramped == 0 && *target == 1.f)
+            return;
 
-        context.isBypassed = bypassed->get();
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+        {
+            auto* samples = buffer.getWritePointer(ch);
+            auto gain = *current;
+
+            for (int n = 0; n < ramped; ++n)
+            {
+                gain += *step;
+                samples[n] *= gain;
+            }
+
+            juce::FloatVectorOperations::multiply(samples + ramped, *target, numSamples - ramped);
+        }
 
-        compressor.process(context);
+        *remaining -= ramped;
+        *current = *remaining > 0 ? *current + *step * (float) ramped : *target;
     }
 
 private:
-    juce::dsp::Compressor<float> compressor;
+    float* current{ nullptr };
+    float* target{ nullptr };
+    float* step{ nullptr };
+    int* remaining{ nullptr };
+    int rampLength{ 1 };
 };
 
 //==============================================================================
@@ -168,38 +489,65 @@ public:
     static APVTS::ParameterLayout createParameterLayout();
     APVTS apvts{ *this, nullptr, "Parameters", createParameterLayout() };
 
+    /** Loudness of the processed output, complete as soon as the last block has been rendered. */
+    const LoudnessMeter& getOutputLoudness() const { return outputLoudness; }
+
+    /** Bytes of DSP state this instance keeps in its arena, on top of sizeof the processor itself. */
+    size_t getDspStateSizeInBytes() const { return arena.getSizeInBytes(); }
+
 private:
     std::array<CompressorBand, 3> compressors;
     CompressorBand& lowBandComp = compressors[0];
     CompressorBand& midBandComp = compressors[1];
     CompressorBand& highBandComp = compressors[2];
 
-    using Filter = juce::dsp::LinkwitzRileyFilter<float>;
     //     fc0  fc1
-    Filter LP1, AP2,
-           HP1, LP2,
-                HP2;
+    //     LP1, AP2,
+    //     HP1, LP2,
+    //          HP2
+    LinkwitzRileyCrossover crossover;
 
     juce::AudioParameterFloat* lowMidCrossover{ nullptr };
     juce::AudioParameterFloat* midHighCrossover{ nullptr };
+    juce::AudioParameterChoice* crossoverSlope{ nullptr };
 
+    // Views onto the band scratch in the arena, re-pointed at the current slice every block.
     std::array<juce::AudioBuffer<float>, 3> filterBuffers;
+    float* bandScratch{ nullptr };
 
-    juce::dsp::Gain<float> inputGain, outputGain;
+    RampedGain inputGain, outputGain;
     juce::AudioParameterFloat* inputGainParam{ nullptr };
     juce::AudioParameterFloat* outputGainParam{ nullptr };
 
-    template<typename T, typename U>
-    void applyGain(T& buffer, U& gain)
-    {
-        auto block = juce::dsp::AudioBlock<float>(buffer);
-        auto ctx = juce::dsp::ProcessContextReplacing<float>(block);
-        gain.process(ctx)
-    }
+    // makeupLoudness measures the band sum ahead of outputGain and only runs in auto makeup mode.
+    LoudnessMeter makeupLoudness, outputLoudness;
+    juce::AudioParameterBool* autoMakeupParam{ nullptr };
+    juce::AudioParameterFloat* targetLoudnessParam{ nullptr };
+    bool autoMakeupEnabled{ false };
+
+    // Last gain auto makeup applied, kept outside the arena so a re-prepare resumes on it.
+    float makeupDecibels{ 0.f };
+    bool hasMakeupGain{ false };
+
+    // Last stage of the chain. It always runs and always adds its latency, so that switching
+    // it doesn't move the host's latency compensation or drop what is in the delay line.
+    TruePeakLimiter limiter;
+    juce::AudioParameterBool* limiterParam{ nullptr };
+    juce::AudioParameterFloat* ceilingParam{ nullptr };
+
+    DspStateArena arena;
+    int numPreparedChannels{ 0 };
+    int maxBlockSize{ 0 };
+
+    void bindDspState(const juce::dsp::ProcessSpec& spec);
 
     void updateState();
+    void updateLimiter();
+    void updateAutoMakeupMode();
+    void updateAutoMakeup(const juce::AudioBuffer<float>& buffer);
     
     void splitBands(const juce::AudioBuffer<float>& inputBuffer);
+    void processSlice(juce::AudioBuffer<float>& buffer);
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MultiBandCompressorAudioProcessor)
 };
\ No newline at end of file
@@ -0,0 +1,156 @@
+#include "TruePeakLimiter.h"
+
+//==============================================================================
+TruePeakLimiter::TruePeakLimiter()
+{
+    // ITU-R BS.1770-4 Annex 2, the 48 tap interpolator of the true-peak meter split into its
+    // four phases. Phase k lands (2k + 1) / 8 of a sample after the input delayed by
+    // detectorDelay, so the phases sit between samples and never on one.
+    static constexpr float coefficients[oversampling][tapsPerPhase] {
+        {  0.0017089843750f,  0.0109863281250f, -0.0196533203125f,  0.0332031250000f, -0.0594482421875f,  0.1373291015625f,
+           0.9721679687500f, -0.1022949218750f,  0.0476074218750f, -0.0266113281250f,  0.0148925781250f, -0.0083007812500f },
+        { -0.0291748046875f,  0.0292968750000f, -0.0517578125000f,  0.0891113281250f, -0.1665039062500f,  0.4650878906250f,
+           0.7797851562500f, -0.2003173828125f,  0.1015625000000f, -0.0582275390625f,  0.0330810546875f, -0.0189208984375f },
+        { -0.0189208984375f,  0.0330810546875f, -0.0582275390625f,  0.1015625000000f, -0.2003173828125f,  0.7797851562500f,
+           0.4650878906250f, -0.1665039062500f,  0.0891113281250f, -0.0517578125000f,  0.0292968750000f, -0.0291748046875f },
+        { -0.0083007812500f,  0.0148925781250f, -0.0266113281250f,  0.0476074218750f, -0.1022949218750f,  0.9721679687500f,
+           0.1373291015625f, -0.0594482421875f,  0.0332031250000f, -0.0196533203125f,  0.0109863281250f,  0.0017089843750f },
+    };
+
+    // Coefficient j weights the input j samples back, the taps are stored oldest first so
+    // they line up with the history window.
+    for (int j = 0; j < tapsPerPhase; ++j)
+        for (size_t k = 0; k < (size_t) oversampling; ++k)
+            phaseTaps[(size_t) (tapsPerPhase - 1 - j)].set(k, coefficients[k][j]);
+}
+
+int TruePeakLimiter::lookaheadFor(double sampleRate)
+{
+    return juce::jmax(1, juce::roundToInt(lookaheadSeconds * sampleRate));
+}
+
+void TruePeakLimiter::bindState(DspStateArena& arena, const juce::dsp::ProcessSpec& spec)
+{
+    auto channels = (size_t) juce::jmin((int) spec.numChannels, maxChannels);
+
+    // The moving average reaches its target lookahead - 1 samples after the detector sees the peak.
+    // The minimum is held one sample longer than that, so both samples around an inter-sample
+    // peak leave with the full reduction.
+    lookahead = lookaheadFor(spec.sampleRate);
+    holdLength = lookahead + 1;
+    delayLength = detectorDelay + lookahead - 1;
+
+    history = arena.take<float>(channels * 2 * tapsPerPhase);
+    delayLine = arena.take<float>(channels * (size_t) delayLength);
+    minValues = arena.take<float>((size_t) holdLength);
+    minTimes = arena.take<juce::int64>((size_t) holdLength);
+    averageRing = arena.take<float>((size_t) lookahead);
+}
+
+void TruePeakLimiter::prepare(const juce::dsp::ProcessSpec& spec)
+{
+    jassert(lookahead == lookaheadFor(spec.sampleRate));
+
+    numChannels = juce::jmin((int) spec.numChannels, maxChannels);
+    releaseCoeff = (float) std::exp(-1.0 / (releaseSeconds * spec.sampleRate));
+
+    reset();
+}
+
+void TruePeakLimiter::reset()
+{
+    if (history == nullptr)
+        return;
+
+    std::fill(history, history + numChannels * 2 * tapsPerPhase, 0.f);
+    std::fill(delayLine, delayLine + numChannels * delayLength, 0.f);
+    std::fill(averageRing, averageRing + lookahead, 1.f);
+
+    historyPos = 0;
+    delayPos = 0;
+    minHead = 0;
+    minSize = 0;
+    time = 0;
+    averagePos = 0;
+    averageSum = lookahead;
+    envelope = 1.f;
+}
+
+void TruePeakLimiter::setCeilingDecibels(float ceilingDb)
+{
+    ceiling = juce::Decibels::decibelsToGain(ceilingDb);
+}
+
+float TruePeakLimiter::slidingMinimum(float value) noexcept
+{
+    // At most one value leaves the window per sample, and anything queued that is not
+    // below the new value can never be the minimum again.
+    if (minSize > 0 && minTimes[minHead] <= time - holdLength)
+    {
+        minHead = (minHead + 1) % holdLength;
+        --minSize;
+    }
+
+    while (minSize > 0 && minValues[(minHead + minSize - 1) % holdLength] >= value)
+        --minSize;
+
+    auto tail = (minHead + minSize) % holdLength;
+    minValues[tail] = value;
+    minTimes[tail] = time;
+    ++minSize;
+    ++time;
+
+    return minValues[minHead];
+}
+
+void TruePeakLimiter::process(juce::AudioBuffer<float>& buffer)
+{
+    auto channels = juce::jmin(numChannels, buffer.getNumChannels());
+    auto numSamples = buffer.getNumSamples();
+    auto* const* samples = buffer.getArrayOfWritePointers();
+
+    for (int n = 0; n < numSamples; ++n)
+    {
+        auto peak = 0.f;
+
+        for (int ch = 0; ch < channels; ++ch)
+        {
+            auto* h = history + ch * 2 * tapsPerPhase;
+            h[historyPos] = h[historyPos + tapsPerPhase] = samples[ch][n];
+
+            auto* window = h + historyPos + 1;
+            auto y = Vec::expand(0.f);
+
+            for (int i = 0; i < tapsPerPhase; ++i)
+                y += phaseTaps[(size_t) i] * Vec::expand(window[i]);
+
+            // The phases skip the samples themselves, so the delayed sample counts as well.
+            peak = juce::jmax(peak, std::abs(window[tapsPerPhase - 1 - detectorDelay]));
+
+            for (size_t k = 0; k < (size_t) oversampling; ++k)
+                peak = juce::jmax(peak, std::abs(y.get(k)));
+        }
+
+        historyPos = (historyPos + 1) % tapsPerPhase;
+
+        auto required = enabled && peak > ceiling ? ceiling / peak : 1.f;
+        auto held = slidingMinimum(required);
+        envelope = held < envelope ? held : held + releaseCoeff * (envelope - held);
+
+        averageSum += envelope - averageRing[averagePos];
+        averageRing[averagePos] = envelope;
+        averagePos = (averagePos + 1) % lookahead;
+
+        auto gain = (float) (averageSum / lookahead);
+
+        for (int ch = 0; ch < channels; ++ch)
+        {
+            auto* d = delayLine + ch * delayLength;
+            auto delayed = d[delayPos];
+            d[delayPos] = samples[ch][n];
+            samples[ch][n] = delayed * gain;
+        }
+
+        delayPos = (delayPos + 1) % delayLength;
+    }
+}
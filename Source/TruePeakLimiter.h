@@ -0,0 +1,93 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "DspStateArena.h"
+
+/**
+    Lookahead limiter that keeps the inter-sample (true) peak below a ceiling.
+
+    Peaks are detected on a 4x oversampled copy of the signal made by the polyphase
+    interpolator of the ITU-R BS.1770 true-peak meter, which is flat to within about
+    0.2 dB up to 0.42 of the sample rate. Each coefficient register holds one tap of
+    all four phases, so one vector multiply-add per tap yields every interpolated
+    sample at once.
+    Only the detector is oversampled, and the audio is simply delayed and
+    scaled in place.
+
+    The gain is computed as a sliding minimum over the lookahead window plus one
+    sample, a one-pole release and then a moving average over the lookahead window.
+    The attack therefore reaches its target exactly when the delayed peak arrives,
+    and holds it for the sample after.
+    Channels share one gain, so limiting does not move the stereo image.
+
+    Switching it off only makes the detector ask for unity gain: the delay line keeps
+    running, so the latency stays the same and the gain releases back to unity instead
+    of jumping there.
+
+    The delay lines and detector history live in the processor's DspStateArena.
+    bindState() has to be called before prepare().
+*/
+class TruePeakLimiter
+{
+public:
+    static constexpr int maxChannels = 2;
+    static constexpr int oversampling = 4;
+    static constexpr int tapsPerPhase = 12;
+
+    TruePeakLimiter();
+
+    void bindState(DspStateArena& arena, const juce::dsp::ProcessSpec& spec);
+    void prepare(const juce::dsp::ProcessSpec& spec);
+    void reset();
+
+    void setCeilingDecibels(float ceilingDb);
+    void setEnabled(bool shouldLimit) noexcept { enabled = shouldLimit; }
+
+    /** Lookahead plus the delay of the interpolator, valid after bindState(), on or off. */
+    int getLatencySamples() const { return delayLength; }
+
+    void process(juce::AudioBuffer<float>& buffer);
+
+private:
+    using Vec = juce::dsp::SIMDRegister<float>;
+    static_assert((int) Vec::SIMDNumElements >= oversampling, "every phase needs its own SIMD lane");
+
+    static constexpr double lookaheadSeconds = 0.0015;
+    static constexpr double releaseSeconds = 0.08;
+
+    // The interpolated samples lie between the input delayed by detectorDelay and the one after.
+    static constexpr int detectorDelay = tapsPerPhase / 2;
+
+    static int lookaheadFor(double sampleRate);
+
+    float slidingMinimum(float value) noexcept;
+
+    std::array<Vec, tapsPerPhase> phaseTaps;
+
+    int numChannels{ 0 };
+    int lookahead{ 1 };
+    int holdLength{ 2 };
+    int delayLength{ detectorDelay };
+    float ceiling{ 1.f };
+    bool enabled{ true };
+    float releaseCoeff{ 0.f };
+
+    // Detector history, 2 * tapsPerPhase per channel so the taps always read one contiguous window.
+    float* history{ nullptr };
+    int historyPos{ 0 };
+
+    float* delayLine{ nullptr };
+    int delayPos{ 0 };
+
+    // Monotonic queue for the sliding minimum, and the moving average ring.
+    float* minValues{ nullptr };
+    juce::int64* minTimes{ nullptr };
+    int minHead{ 0 }, minSize{ 0 };
+    juce::int64 time{ 0 };
+
+    float* averageRing{ nullptr };
+    int averagePos{ 0 };
+    double averageSum{ 0 };
+
+    float envelope{ 1.f };
+};
@@ -0,0 +1,489 @@
+/*
+  ==============================================================================
+
+    Headless host simulation for MultiBandCompressorAudioProcessor.
+
+    Drives the processor the way real hosts do and reports how long processBlock
+    takes, as a fraction of the host's callback periods:
+
+      - block sizes change from block to block, from single samples up to blocks
+        larger than the size passed to prepareToPlay
+      - sessions at different sample rates, each wrapped in prepareToPlay and
+        releaseResources
+      - bursts of parameter automation, including solo, mute and bypass toggles
+      - silent, denormal-prone, noisy and full scale input
+
+    Usage: StressHarness [--sessions=N] [--blocks=N] [--budget=F] [--seed=N]
+           StressHarness --perf
+           StressHarness --true-peak
+
+
+    --budget is the real-time budget, the largest share of a callback period that
+    processBlock may take. Consecutive calls are grouped into callback periods until
+    they cover the block size passed to prepareToPlay, the way a host that splits its
+    buffer around automation points makes all of those calls share one period. Each
+    period's summed time is divided by the duration of the samples it covered. Calls of
+    up to 16 samples are also reported on their own, in microseconds per call, since
+    their cost is mostly fixed overhead. Periods during which the OS took the CPU away
+    from the harness (involuntary context switches, where the OS reports them) are
+    counted but left out of every figure and of the gate, and so are preempted small
+    calls, their time says more about the machine than about processBlock. The harness exits with 1 when the worst remaining period exceeds the
+    budget, or when the output contains anything that is not a finite number.
+
+    --perf profiles how the DSP state sits in the caches instead: one stereo session
+    at 48 kHz / 512, timed once with warm caches and once with every block starting
+    cold, plus L1D and last level cache misses per sample where the OS exposes the
+    hardware counters (Linux perf events).
+
+    Before the stress run, and on its own with --true-peak, the true-peak limiter is
+    driven over its ceiling and measured with a BS.1770 true-peak meter and a finer
+    reference one (see TruePeakCheck.h). A failure there also makes the harness exit
+    with 1.
+
+    Only Linux says which periods were preempted and exposes the cache counters, so
+    build it with the LinuxMakefile exporter for those. Elsewhere no period is ever
+    left out of the figures, and --perf only reports timings.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include <chrono>
+#include "../../Source/PluginProcessor.h"
+#include "TruePeakCheck.h"
+
+#if JUCE_LINUX
+ #include <linux/perf_event.h>
+ #include <sys/ioctl.h>
+ #include <sys/resource.h>
+ #include <sys/syscall.h>
+ #include <unistd.h>
+#endif
+
+namespace
+{
+    enum class Input
+    {
+        silence,
+        denormals,
+        noise,
+        fullScale,
+    };
+
+    const std::array<double, 5> sampleRates{ 44100.0, 48000.0, 88200.0, 96000.0, 192000.0 };
+    const std::array<int, 5> preparedBlockSizes{ 32, 64, 256, 512, 1024 };
+    constexpr int smallBlockSize = 16;
+
+    struct Options
+    {
+        int sessions = 40;
+        int blocksPerSession = 2000;
+        double budget = 0.5;
+        juce::int64 seed = 1;
+    };
+
+    Options parseOptions(const juce::ArgumentList& args)
+    {
+        Options options;
+
+        auto intOption = [&args](const char* name, int fallback)
+        {
+            auto value = args.getValueForOption(name);
+            return value.isNotEmpty() ? value.getIntValue() : fallback;
+        };
+
+        options.sessions = juce::jmax(1, intOption("--sessions", options.sessions));
+        options.blocksPerSession = juce::jmax(1, intOption("--blocks", options.blocksPerSession));
+        options.seed = intOption("--seed", (int) options.seed);
+
+        auto budget = args.getValueForOption("--budget");
+        if (budget.isNotEmpty())
+            options.budget = budget.getDoubleValue();
+
+        return options;
+    }
+
+    int pickBlockSize(juce::Random& random, int preparedSize)
+    {
+        switch (random.nextInt(6))
+        {
+            case 0:  return 1;
+            case 1:  return 1 + random.nextInt(16);
+            case 2:  return preparedSize;
+            case 3:  return preparedSize * 2 + 1 + random.nextInt(preparedSize);
+            default: return 1 + random.nextInt(preparedSize);
+        }
+    }
+
+    void fillInput(juce::AudioBuffer<float>& buffer, int numSamples, Input input, juce::Random& random)
+    {
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+        {
+            auto* samples = buffer.getWritePointer(ch);
+
+            for (int n = 0; n < numSamples; ++n)
+            {
+                switch (input)
+                {
+                    case Input::silence:   samples[n] = 0.f; break;
+                    case Input::denormals: samples[n] = (random.nextFloat() - 0.5f) * 1.0e-38f; break;
+                    case Input::noise:     samples[n] = (random.nextFloat() - 0.5f) * 0.5f; break;
+                    case Input::fullScale: samples[n] = random.nextBool() ? 1.f : -1.f; break;
+                }
+            }
+        }
+    }
+
+    /** Moves a burst of random parameters, the way host automation lands on the audio thread. */
+    void automate(juce::AudioProcessor& processor, juce::Random& random, int numChanges)
+    {
+        auto& params = processor.getParameters();
+
+        for (int i = 0; i < numChanges; ++i)
+        {
+            auto* param = params[random.nextInt(params.size())];
+
+            // Switches flip, everything else jumps anywhere in its range.
+            auto value = param->isBoolean() ? (param->getValue() < 0.5f ? 1.f : 0.f) : random.nextFloat();
+            param->setValueNotifyingHost(value);
+        }
+    }
+
+    bool isFinite(const juce::AudioBuffer<float>& buffer, int numSamples)
+    {
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+        {
+            auto range = juce::FloatVectorOperations::findMinAndMax(buffer.getReadPointer(ch), numSamples);
+            if (!std::isfinite(range.getStart()) || !std::isfinite(range.getEnd()))
+                return false;
+        }
+
+        return true;
+    }
+
+    /** processBlock calls that together cover one callback period of the host. */
+    struct Period
+    {
+        double load = 0.0;
+        double microseconds = 0.0;
+        int numSamples = 0;
+        int numCalls = 0;
+        bool preempted = false;
+    };
+
+    /** Involuntary context switches of the calling thread so far, or 0 where the OS doesn't say. */
+    long countPreemptions()
+    {
+       #if JUCE_LINUX
+        rusage usage{};
+        if (getrusage(RUSAGE_THREAD, &usage) == 0)
+            return usage.ru_nivcsw;
+       #endif
+        return 0;
+    }
+
+    double percentile(std::vector<double> values, double p)
+    {
+        std::sort(values.begin(), values.end());
+        auto index = (size_t) juce::jlimit(0.0, (double) values.size() - 1.0, std::ceil(p * (double) values.size()) - 1.0);
+        return values[index];
+    }
+
+    /** L1D read and last level cache misses of the calling thread, counted while started. */
+    class CacheMissCounters
+    {
+    public:
+        CacheMissCounters()
+        {
+           #if JUCE_LINUX
+            l1Misses = open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+                                                  | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                                  | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+            llcMisses = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+           #endif
+        }
+
+        ~CacheMissCounters()
+        {
+           #if JUCE_LINUX
+            for (auto fd : { l1Misses, llcMisses })
+                if (fd >= 0)
+                    close(fd);
+           #endif
+        }
+
+        bool isAvailable() const { return l1Misses >= 0 && llcMisses >= 0; }
+
+        void start()
+        {
+           #if JUCE_LINUX
+            for (auto fd : { l1Misses, llcMisses })
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+           #endif
+        }
+
+        void stop()
+        {
+           #if JUCE_LINUX
+            for (auto fd : { l1Misses, llcMisses })
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+           #endif
+        }
+
+        /** Misses counted so far, then starts counting from zero again. */
+        std::pair<juce::int64, juce::int64> readAndClear()
+        {
+            return { readAndClear(l1Misses), readAndClear(llcMisses) };
+        }
+
+    private:
+        static int open(juce::uint32 type, juce::uint64 config)
+        {
+           #if JUCE_LINUX
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+           #else
+            juce::ignoreUnused(type, config);
+            return -1;
+           #endif
+        }
+
+        static juce::int64 readAndClear(int fd)
+        {
+            juce::int64 count = 0;
+           #if JUCE_LINUX
+            if (read(fd, &count, sizeof(count)) != (ssize_t) sizeof(count))
+                count = 0;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+           #else
+            juce::ignoreUnused(fd);
+           #endif
+            return count;
+        }
+
+        int l1Misses{ -1 }, llcMisses{ -1 };
+    };
+
+    /**
+        Runs one steady session twice: with warm caches, and with a buffer larger than any
+        last level cache written between blocks so that every block starts cold. The cold
+        penalty is what scattered DSP state costs, the arena is meant to keep it small.
+    */
+    int profileCaches(MultiBandCompressorAudioProcessor& processor, juce::Random& random)
+    {
+        constexpr double sampleRate = 48000.0;
+        constexpr int blockSize = 512;
+        constexpr int numBlocks = 300;
+
+        processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+        processor.prepareToPlay(sampleRate, blockSize);
+
+        juce::MidiBuffer midi;
+        juce::AudioBuffer<float> buffer(processor.getTotalNumOutputChannels(), blockSize);
+        std::vector<char> evictor((size_t) 64 << 20);
+        CacheMissCounters counters;
+
+        auto run = [&](bool cold)
+        {
+            std::vector<double> microseconds;
+            juce::int64 l1 = 0, llc = 0;
+
+            for (int block = 0; block < numBlocks; ++block)
+            {
+                if (cold)
+                    for (size_t i = 0; i < evictor.size(); i += 64)
+                        ++evictor[i];
+
+                fillInput(buffer, blockSize, Input::noise, random);
+
+                counters.start();
+                auto start = std::chrono::steady_clock::now();
+                processor.processBlock(buffer, midi);
+                auto end = std::chrono::steady_clock::now();
+                counters.stop();
+
+                auto misses = counters.readAndClear();
+                l1 += misses.first;
+                llc += misses.second;
+                microseconds.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+            }
+
+            auto samples = (double) numBlocks * blockSize;
+            std::cout << (cold ? "cold" : "warm") << " caches: " << percentile(microseconds, 0.5) << " us per block (median)";
+            if (counters.isAvailable())
+                std::cout << ", " << (double) l1 / samples << " L1D misses and " << (double) llc / samples << " LLC misses per sample";
+            std::cout << std::endl;
+
+            return percentile(microseconds, 0.5);
+        };
+
+        std::cout << "DSP state arena: " << processor.getDspStateSizeInBytes() << " bytes, "
+                  << (processor.getDspStateSizeInBytes() + 63) / 64 << " cache lines" << std::endl;
+
+        if (!counters.isAvailable())
+            std::cout << "hardware cache counters unavailable, timing only" << std::endl;
+
+        run(false);
+        auto warm = run(false);
+        auto cold = run(true);
+
+        std::cout << "cold penalty: " << 1000.0 * (cold - warm) / blockSize << " ns per sample" << std::endl;
+
+        processor.releaseResources();
+        return 0;
+    }
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::ArgumentList args(argc, argv);
+    auto options = parseOptions(args);
+    juce::Random random(options.seed);
+
+    MultiBandCompressorAudioProcessor processor;
+
+    if (args.containsOption("--perf"))
+        return profileCaches(processor, random);
+
+    auto truePeakPassed = checkTruePeakLimiter();
+
+    if (args.containsOption("--true-peak"))
+    {
+        std::cout << (truePeakPassed ? "PASS" : "FAIL: true peak above the ceiling or wrong latency") << std::endl;
+        return truePeakPassed ? 0 : 1;
+    }
+
+    juce::MidiBuffer midi;
+
+    std::vector<Period> periods;
+    std::vector<double> smallBlockMicroseconds;
+    periods.reserve((size_t) (options.sessions * options.blocksPerSession));
+    smallBlockMicroseconds.reserve((size_t) (options.sessions * options.blocksPerSession));
+
+    auto outputIsFinite = true;
+
+    for (int session = 0; session < options.sessions; ++session)
+    {
+        auto sampleRate = sampleRates[(size_t) random.nextInt((int) sampleRates.size())];
+        auto preparedSize = preparedBlockSizes[(size_t) random.nextInt((int) preparedBlockSizes.size())];
+
+        processor.setRateAndBufferSizeDetails(sampleRate, preparedSize);
+        processor.prepareToPlay(sampleRate, preparedSize);
+
+        if (session == 0)
+            std::cout << "DSP state arena: " << processor.getDspStateSizeInBytes() << " bytes per instance" << std::endl;
+
+        // Room for the largest block pickBlockSize() can ask for, allocated before anything is timed.
+        juce::AudioBuffer<float> storage(processor.getTotalNumOutputChannels(), preparedSize * 3 + 1);
+        auto input = static_cast<Input>(random.nextInt(4));
+        Period period;
+
+        for (int block = 0; block < options.blocksPerSession; ++block)
+        {
+            if (random.nextInt(200) == 0)
+                input = static_cast<Input>(random.nextInt(4));
+
+            if (random.nextInt(50) == 0)
+                automate(processor, random, 1 + random.nextInt(32));
+
+            auto numSamples = pickBlockSize(random, preparedSize);
+            juce::AudioBuffer<float> buffer(storage.getArrayOfWritePointers(), storage.getNumChannels(), numSamples);
+            fillInput(buffer, numSamples, input, random);
+
+            auto preemptions = countPreemptions();
+            auto start = std::chrono::steady_clock::now();
+            processor.processBlock(buffer, midi);
+            auto end = std::chrono::steady_clock::now();
+            auto preempted = countPreemptions() != preemptions;
+
+            auto microseconds = std::chrono::duration<double, std::micro>(end - start).count();
+
+            if (numSamples <= smallBlockSize && !preempted)
+                smallBlockMicroseconds.push_back(microseconds);
+
+            // A host that splits its buffer makes all of the calls share one callback period,
+            // so calls are summed until they cover the prepared block size.
+            period.microseconds += microseconds;
+            period.numSamples += numSamples;
+            ++period.numCalls;
+            period.preempted = period.preempted || preempted;
+
+            if (period.numSamples >= preparedSize)
+            {
+                period.load = period.microseconds / (1.0e6 * period.numSamples / sampleRate);
+                periods.push_back(period);
+                period = {};
+            }
+
+            outputIsFinite = outputIsFinite && isFinite(buffer, numSamples);
+        }
+
+        processor.releaseResources();
+    }
+
+    // Every figure below comes from the same periods, the ones the OS left alone.
+    std::vector<double> loads;
+    loads.reserve(periods.size());
+    Period worst;
+
+    for (const auto& p : periods)
+    {
+        if (p.preempted)
+            continue;
+
+        loads.push_back(p.load);
+
+        if (p.load > worst.load)
+            worst = p;
+    }
+
+    auto numPreempted = periods.size() - loads.size();
+
+    auto mean = std::accumulate(loads.begin(), loads.end(), 0.0) / (double) loads.size();
+    auto variance = std::accumulate(loads.begin(), loads.end(), 0.0, [mean](double sum, double l) { return sum + (l - mean) * (l - mean); }) / (double) loads.size();
+
+    std::cout << "periods:     " << loads.size() << std::endl
+              << "median load: " << percentile(loads, 0.5) << std::endl
+              << "p99.9 load:  " << percentile(loads, 0.999) << std::endl
+              << "worst load:  " << worst.load << " (" << worst.microseconds << " us for " << worst.numSamples
+              << " samples in " << worst.numCalls << " calls)" << std::endl
+              << "jitter:      " << std::sqrt(variance) << " (std dev of load)" << std::endl
+              << "preempted:   " << numPreempted << " periods, left out of all of the above" << std::endl;
+
+    if (!smallBlockMicroseconds.empty())
+        std::cout << "small calls: " << smallBlockMicroseconds.size() << " of up to " << smallBlockSize << " samples, "
+                  << percentile(smallBlockMicroseconds, 0.5) << " us median, "
+                  << percentile(smallBlockMicroseconds, 1.0) << " us worst" << std::endl;
+
+    std::cout << "budget:      " << options.budget << " of the callback period" << std::endl;
+
+    if (!truePeakPassed)
+    {
+        std::cout << "FAIL: true peak above the ceiling or wrong latency" << std::endl;
+        return 1;
+    }
+
+    if (!outputIsFinite)
+    {
+        std::cout << "FAIL: output contained NaN or infinity" << std::endl;
+        return 1;
+    }
+
+    if (worst.load > options.budget)
+    {
+        std::cout << "FAIL: worst callback period exceeded the real-time budget" << std::endl;
+        return 1;
+    }
+
+    std::cout << "PASS" << std::endl;
+    return 0;
+}
@@ -0,0 +1,306 @@
+#include <JuceHeader.h>
+#include "TruePeakCheck.h"
+#include "../../Source/TruePeakLimiter.h"
+
+namespace
+{
+    constexpr float ceilingDb = -1.f;
+
+    // The limiter uses the BS.1770 interpolator, so that meter must never read above the ceiling
+    // by more than float rounding.
+    constexpr float meterToleranceDb = 0.01f;
+
+    // Between its 4x points a BS.1770 meter can under-read content up to 0.42 of the sample
+    // rate, where its interpolator stays flat, by up to 20 log10(cos(2 pi 0.42 / 8)) = 0.48 dB.
+    constexpr float referenceToleranceDb = 0.5f;
+
+    constexpr double pi = juce::MathConstants<double>::pi;
+
+    /**
+        True peak as ITU-R BS.1770-4 Annex 2 measures it: zero stuffed to 4x, filtered by its
+        48 tap interpolator and the largest magnitude taken. This is the reading loudness
+        and delivery specs are checked against.
+    */
+    float bs1770TruePeak(const std::vector<float>& x)
+    {
+        // The standard lists the filter as four phases of 12 taps, phase k holding taps k, k + 4, ...
+        static constexpr double phases[4][12] {
+            {  0.0017089843750,  0.0109863281250, -0.0196533203125,  0.0332031250000, -0.0594482421875,  0.1373291015625,
+               0.9721679687500, -0.1022949218750,  0.0476074218750, -0.0266113281250,  0.0148925781250, -0.0083007812500 },
+            { -0.0291748046875,  0.0292968750000, -0.0517578125000,  0.0891113281250, -0.1665039062500,  0.4650878906250,
+               0.7797851562500, -0.2003173828125,  0.1015625000000, -0.0582275390625,  0.0330810546875, -0.0189208984375 },
+            { -0.0189208984375,  0.0330810546875, -0.0582275390625,  0.1015625000000, -0.2003173828125,  0.7797851562500,
+               0.4650878906250, -0.1665039062500,  0.0891113281250, -0.0517578125000,  0.0292968750000, -0.0291748046875 },
+            { -0.0083007812500,  0.0148925781250, -0.0266113281250,  0.0476074218750, -0.1022949218750,  0.9721679687500,
+               0.1373291015625, -0.0594482421875,  0.0332031250000, -0.0196533203125,  0.0109863281250,  0.0017089843750 },
+        };
+
+        std::vector<double> stuffed(x.size() * 4);
+        for (size_t n = 0; n < x.size(); ++n)
+            stuffed[4 * n] = x[n];
+
+        auto peak = 0.0;
+
+        for (size_t m = 0; m < stuffed.size(); ++m)
+        {
+            auto y = 0.0;
+            for (size_t i = 0; i < 48 && i <= m; ++i)
+                y += phases[i % 4][i / 4] * stuffed[m - i];
+
+            peak = juce::jmax(peak, std::abs(y));
+        }
+
+        return (float) peak;
+    }
+
+    /** Blackman-Harris windowed sinc, u in samples, nonzero for |u| < halfWidth. */
+    double windowedSinc(double u, double cutoff, int halfWidth)
+    {
+        if (std::abs(u) >= halfWidth)
+            return 0.0;
+
+        auto x = 2.0 * cutoff * u;
+        auto sinc = x == 0.0 ? 1.0 : std::sin(pi * x) / (pi * x);
+        auto w = pi * u / halfWidth;
+
+        return 2.0 * cutoff * sinc * (0.35875 + 0.48829 * std::cos(w) + 0.14128 * std::cos(2.0 * w) + 0.01168 * std::cos(3.0 * w));
+    }
+
+    /**
+        True peak by 16x oversampling through a 128 tap windowed sinc, flat to well above
+        0.45 of the sample rate. Much slower than a real-time meter, and deliberately not
+        the BS.1770 interpolator the limiter itself uses.
+    */
+    float referenceTruePeak(const std::vector<float>& x)
+    {
+        constexpr int oversampling = 16;
+        constexpr int halfWidth = 64;
+
+        std::vector<double> taps((size_t) (oversampling * 2 * halfWidth));
+        for (int p = 0; p < oversampling; ++p)
+            for (int j = -halfWidth + 1; j <= halfWidth; ++j)
+                taps[(size_t) (p * 2 * halfWidth + j + halfWidth - 1)] = windowedSinc((double) p / oversampling - j, 0.5, halfWidth);
+
+        auto size = (int) x.size();
+        auto peak = 0.0;
+
+        for (int n = 0; n < size; ++n)
+        {
+            for (int p = 0; p < oversampling; ++p)
+            {
+                const auto* h = taps.data() + p * 2 * halfWidth;
+                auto y = 0.0;
+
+                for (int j = juce::jmax(-halfWidth + 1, -n); j <= juce::jmin(halfWidth, size - 1 - n); ++j)
+                    y += x[(size_t) (n + j)] * h[j + halfWidth - 1];
+
+                peak = juce::jmax(peak, std::abs(y));
+            }
+        }
+
+        return (float) peak;
+    }
+
+    struct Limiter
+    {
+        explicit Limiter(double sampleRate)
+            : spec{ sampleRate, 512, 1 }
+        {
+            arena.beginMeasuring();
+            limiter.bindState(arena, spec);
+            arena.allocate();
+            limiter.bindState(arena, spec);
+            limiter.prepare(spec);
+            limiter.setCeilingDecibels(ceilingDb);
+        }
+
+        std::vector<float> process(std::vector<float> signal)
+        {
+            for (size_t start = 0; start < signal.size(); start += spec.maximumBlockSize)
+            {
+                auto* samples = signal.data() + start;
+                auto numSamples = (int) juce::jmin((size_t) spec.maximumBlockSize, signal.size() - start);
+                juce::AudioBuffer<float> block(&samples, 1, numSamples);
+                limiter.process(block);
+            }
+
+            return signal;
+        }
+
+        juce::dsp::ProcessSpec spec;
+        DspStateArena arena;
+        TruePeakLimiter limiter;
+    };
+
+    /**
+        Sine at +6 dBFS with 5 ms fades at both ends, so that it stays band limited, followed
+        by enough silence for the limiter to let all of it out.
+    */
+    std::vector<float> tone(double sampleRate, std::initializer_list<double> frequencies, double phase)
+    {
+        auto length = sampleRate / 2;
+        std::vector<float> x((size_t) (length + 0.01 * sampleRate));
+        auto fadeLength = 0.005 * sampleRate;
+        auto amplitude = 2.0 / (double) frequencies.size();
+
+        for (size_t n = 0; n < (size_t) length; ++n)
+        {
+            auto edge = juce::jmin((double) n, length - 1.0 - (double) n);
+            auto fade = edge < fadeLength ? 0.5 - 0.5 * std::cos(pi * edge / fadeLength) : 1.0;
+            auto sum = 0.0;
+
+            for (auto f : frequencies)
+                sum += std::sin(2.0 * pi * f * (double) n / sampleRate + phase);
+
+            x[n] = (float) (fade * amplitude * sum);
+        }
+
+        return x;
+    }
+
+    /**
+        White noise low passed to 0.38 of the sample rate, scaled to +6 dBFS sample peaks.
+        The noise starts and stops in silence, the filter rings in and out of it.
+    */
+    std::vector<float> bandLimitedNoise(double sampleRate)
+    {
+        constexpr int halfWidth = 64;
+
+        juce::Random random(1);
+        std::vector<float> white((size_t) (sampleRate / 2) + 2 * halfWidth);
+        for (size_t n = 2 * halfWidth; n < white.size() - 2 * halfWidth; ++n)
+            white[n] = random.nextFloat() - 0.5f;
+
+        std::vector<float> x(white.size() + (size_t) (0.01 * sampleRate));
+        auto peak = 0.f;
+
+        for (size_t n = 0; n < white.size() - 2 * halfWidth; ++n)
+        {
+            auto y = 0.0;
+            for (int j = -halfWidth + 1; j < halfWidth; ++j)
+                y += white[n + (size_t) (halfWidth + j)] * windowedSinc(j, 0.38, halfWidth);
+
+            x[n] = (float) y;
+            peak = juce::jmax(peak, std::abs(x[n]));
+        }
+
+        for (auto& s : x)
+            s *= 2.f / peak;
+
+        return x;
+    }
+
+    bool checkSignal(double sampleRate, const juce::String& name, const std::vector<float>& input)
+    {
+        Limiter limiter(sampleRate);
+        auto output = limiter.process(input);
+
+        auto meteredDb = juce::Decibels::gainToDecibels(bs1770TruePeak(output));
+        auto referenceDb = juce::Decibels::gainToDecibels(referenceTruePeak(output));
+        auto passed = meteredDb <= ceilingDb + meterToleranceDb && referenceDb <= ceilingDb + referenceToleranceDb;
+
+        std::cout << "  " << name.paddedRight(' ', 24) << juce::String(meteredDb, 2) << " dBTP BS.1770, "
+                  << juce::String(referenceDb, 2) << " dBTP reference"
+                  << (passed ? "" : "  FAIL") << std::endl;
+
+        return passed;
+    }
+
+    /** A quiet impulse passes unchanged and a loud one is pulled to the ceiling, both after exactly the latency. */
+    bool checkLatency(double sampleRate)
+    {
+        Limiter limiter(sampleRate);
+        auto latency = limiter.limiter.getLatencySamples();
+
+        constexpr int quietAt = 100;
+        auto loudAt = quietAt + (int) sampleRate / 10;
+
+        std::vector<float> input((size_t) (loudAt + latency + 100));
+        input[(size_t) quietAt] = 0.5f;
+        input[(size_t) loudAt] = 4.f;
+
+        auto output = limiter.process(input);
+
+        auto quiet = output[(size_t) (quietAt + latency)];
+        auto loud = output[(size_t) (loudAt + latency)];
+        auto ceiling = juce::Decibels::decibelsToGain(ceilingDb);
+
+        auto passed = std::abs(quiet - 0.5f) < 1.0e-4f && loud <= ceiling && loud > 0.98f * ceiling;
+
+        std::cout << "  latency " << latency << " samples, impulses leave at " << quiet << " and " << loud
+                  << (passed ? "" : "  FAIL") << std::endl;
+
+        return passed;
+    }
+
+    /**
+        Switches the limiter off and on every 0.1 s under a loud tone. The delay line keeps
+        running either way, so the output must never drop out or jump: the gain it applies
+        may only move as fast as the limiter's own attack ramp.
+    */
+    bool checkSwitching(double sampleRate)
+    {
+        Limiter limiter(sampleRate);
+        auto latency = (size_t) limiter.limiter.getLatencySamples();
+        auto input = tone(sampleRate, { 1000.0 }, 0.0);
+        auto output = input;
+
+        constexpr size_t blockSize = 64;
+        auto switchEvery = (size_t) (sampleRate / 10);
+
+        for (size_t start = 0; start < output.size(); start += blockSize)
+        {
+            limiter.limiter.setEnabled((start / switchEvery) % 2 == 0);
+
+            auto* samples = output.data() + start;
+            juce::AudioBuffer<float> block(&samples, 1, (int) juce::jmin(blockSize, output.size() - start));
+            limiter.limiter.process(block);
+        }
+
+        auto largestStep = 0.f, lastGain = 1.f;
+
+        for (size_t n = latency; n < output.size(); ++n)
+        {
+            auto delayed = input[n - latency];
+            if (std::abs(delayed) < 0.05f)
+                continue;
+
+            auto gain = output[n] / delayed;
+            largestStep = juce::jmax(largestStep, std::abs(gain - lastGain));
+            lastGain = gain;
+        }
+
+        // Full reduction spread over the lookahead, with room to spare.
+        auto passed = largestStep < 2.f / (float) limiter.limiter.getLatencySamples();
+
+        std::cout << "  switched every 100 ms, largest gain step " << largestStep << " per sample"
+                  << (passed ? "" : "  FAIL") << std::endl;
+
+        return passed;
+    }
+}
+
+//==============================================================================
+bool checkTruePeakLimiter()
+{
+    auto passed = true;
+
+    for (auto sampleRate : { 44100.0, 48000.0 })
+    {
+        std::cout << "true-peak limiter, ceiling " << ceilingDb << " dBTP, " << sampleRate << " Hz:" << std::endl;
+
+        passed = checkLatency(sampleRate) && passed;
+        passed = checkSwitching(sampleRate) && passed;
+
+        // Fractions of the sample rate, 0.4 being 19.2 kHz at 48 kHz.
+        for (auto f : { 0.02, 0.2, 0.3125, 0.35, 0.375, 0.4 })
+            passed = checkSignal(sampleRate, juce::String(juce::roundToInt(f * sampleRate)) + " Hz sine", tone(sampleRate, { f * sampleRate }, 0.0)) && passed;
+
+        // A quarter of the sample rate at 45 degrees has every sample 3 dB below the true peak.
+        passed = checkSignal(sampleRate, juce::String(juce::roundToInt(sampleRate / 4)) + " Hz sine at 45 deg", tone(sampleRate, { sampleRate / 4 }, pi / 4)) && passed;
+        passed = checkSignal(sampleRate, "two tones near 0.36 fs", tone(sampleRate, { 0.35 * sampleRate, 0.37 * sampleRate }, 0.0)) && passed;
+        passed = checkSignal(sampleRate, "band limited noise", bandLimitedNoise(sampleRate)) && passed;
+    }
+
+    return passed;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+/**
+    Drives the TruePeakLimiter 7 dB over its ceiling with tones up to 0.4 of the
+    sample rate and band limited noise, and measures the output twice: with a
+    BS.1770 true-peak meter, which must not read above the ceiling, and with a
+    16x oversampled reference meter, which may read above it by no more than a
+    4x meter can miss. Also checks that impulses leave after exactly the
+    reported latency.
+
+    Prints one line per signal and returns false when any of them fails.
+*/
+bool checkTruePeakLimiter();